@@ -25,7 +25,7 @@ ENDIF()
 include_directories(${MONGOC_INCLUDE_DIR})
 include_directories(${BSON_INCLUDE_DIR})
 
-HHVM_EXTENSION(mongo src/ext_mongo.cpp src/mongo_common.cpp src/MongoClient.cpp src/MongoCursor.cpp src/MongoCollection.cpp src/bson.cpp src/bson_decode.cpp src/contrib/encode.cpp)
+HHVM_EXTENSION(mongo src/ext_mongo.cpp src/mongo_common.cpp src/mongo_counters.cpp src/mongo_write_queue.cpp src/mongo_spool.cpp src/mongo_metadata_cache.cpp src/mongo_resolver.cpp src/mongo_wire_stats.cpp src/MongoClient.cpp src/MongoCursor.cpp src/MongoCollection.cpp src/MongoDB.cpp src/mongo_types.cpp src/bson.cpp src/bson_decode.cpp src/bson_compare.cpp src/MongoMatcher.cpp src/MongoOplogTailer.cpp src/MongoWriteQueue.cpp src/MongoSpool.cpp src/MongoShardedClient.cpp src/contrib/encode.cpp)
 HHVM_SYSTEMLIB(mongo src/ext_mongo.php)
 
 target_link_libraries(mongo ${MONGOC_LIBRARY})
@@ -1,4 +1,6 @@
 #include "ext_mongo.h"
+#include "mongo_resolver.h"
+#include "mongo_wire_stats.h"
 
 #if HHVM_API_VERSION < 20140702L
 #define throw_not_implemented(msg) \
@@ -11,17 +13,43 @@ namespace HPHP {
 // class MongoClient
 
 static void HHVM_METHOD(MongoClient, __construct, const String& uri, Array options) {
-    
-MongocClient *client = MongocClient::GetPersistent(uri);
+  String client_uri = uri;
+
+  // Credentials given as options are bound to the connection string, like
+  // those given in it
+  if (options.exists(String("username")) && options.exists(String("password"))) {
+    String auth_source = options.exists(String("db")) ? options[String("db")].toString() : String("admin");
+    client_uri = String(uri_with_credentials(uri.toCppString(),
+                                             options[String("username")].toString().toCppString(),
+                                             options[String("password")].toString().toCppString(),
+                                             auth_source.toCppString()));
+  }
 
-  if (client == nullptr) {
-    client = new MongocClient(uri);
+  // OP_COMPRESSED is negotiated in the handshake; libmongoc 1.9 or later
+  // built with the compressor is needed, otherwise the option is ignored
+  if (options.exists(String("compressors"))) {
+    Variant compressors = options[String("compressors")];
+    std::string list;
+    if (compressors.isArray()) {
+      for (ArrayIter it(compressors.toArray()); it; ++it) {
+        list += (list.empty() ? "" : ",") + it.second().toString().toCppString();
+      }
+    } else {
+      list = compressors.toString().toCppString();
+    }
+    client_uri = String(uri_with_option(client_uri.toCppString(), "compressors", list));
+  }
+  if (options.exists(String("zlibCompressionLevel"))) {
+    client_uri = String(uri_with_option(client_uri.toCppString(), "zlibCompressionLevel",
+                                        options[String("zlibCompressionLevel")].toString().toCppString()));
   }
-  if (client->isInvalid()) {
+
+  bool created;
+  MongocClient *client = get_persistent_client(client_uri, &created);
+  if (client == nullptr) {
       mongoThrow<MongoConnectionException>(("unable connect to "+uri+", Uri error ").c_str());
   }
 
-  MongocClient::SetPersistent(uri, client);
   this_->o_set(s_mongoc_client, client, s_mongoclient);
 }
 
@@ -97,7 +125,7 @@ static String HHVM_METHOD(MongoClient, getServerVersion) {
   bson_destroy(&buildInfo);
 
   if ( ! result) {
-    mongoThrow<MongoResultException>(strcat("Command error: ", error.message));
+    mongoThrow<MongoResultException>((std::string("Command error: ") + error.message).c_str(), error.code);
   }
 
   if (bson_iter_init_find(&iter, &reply, "version")) {
@@ -109,6 +137,56 @@ static String HHVM_METHOD(MongoClient, getServerVersion) {
   return retval;
 }
 
+static void HHVM_STATIC_METHOD(MongoClient, configureResolver, const Array& options) {
+  MongoResolverOptions resolver_options = mongo_resolver_options();
+
+  if (options.exists(String("enabled"))) {
+    resolver_options.enabled = options[String("enabled")].toBoolean();
+  }
+  if (options.exists(String("ttl"))) {
+    resolver_options.ttl_ms = options[String("ttl")].toInt64();
+  }
+  if (options.exists(String("negativeTtl"))) {
+    resolver_options.negative_ttl_ms = options[String("negativeTtl")].toInt64();
+  }
+  mongo_resolver_configure(resolver_options);
+  if (!resolver_options.enabled) {
+    mongo_resolver_clear();
+  }
+}
+
+static Array HHVM_STATIC_METHOD(MongoClient, getResolverStats) {
+  MongoResolverStats stats = mongo_resolver_stats();
+  Array ret = Array::Create();
+
+  ret.set(String("entries"), stats.entries);
+  ret.set(String("hits"), stats.hits);
+  ret.set(String("misses"), stats.misses);
+  ret.set(String("staleHits"), stats.stale_hits);
+  ret.set(String("negativeHits"), stats.negative_hits);
+  ret.set(String("refreshes"), stats.refreshes);
+  ret.set(String("refreshFailures"), stats.refresh_failures);
+  return ret;
+}
+
+static Array HHVM_STATIC_METHOD(MongoClient, getWireStats) {
+  MongoWireStats stats = mongo_wire_stats();
+  Array ret = Array::Create();
+
+  ret.set(String("bytesOut"), stats.bytes_out);
+  ret.set(String("bytesOutUncompressed"), stats.bytes_out_uncompressed);
+  ret.set(String("bytesIn"), stats.bytes_in);
+  ret.set(String("bytesInUncompressed"), stats.bytes_in_uncompressed);
+  ret.set(String("messagesOut"), stats.messages_out);
+  ret.set(String("messagesIn"), stats.messages_in);
+  ret.set(String("compressedOut"), stats.compressed_out);
+  ret.set(String("compressedIn"), stats.compressed_in);
+  ret.set(String("connectionsTcp"), stats.connections_tcp);
+  ret.set(String("connectionsUnix"), stats.connections_unix);
+  ret.set(String("connectFailures"), stats.connect_failures);
+  return ret;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 void MongoExtension::_initMongoClientClass() {
@@ -127,6 +205,9 @@ void MongoExtension::_initMongoClientClass() {
     HHVM_ME(MongoClient, setReadPreference);
     HHVM_ME(MongoClient, __toString);
     HHVM_ME(MongoClient, getServerVersion);
+    HHVM_STATIC_ME(MongoClient, configureResolver);
+    HHVM_STATIC_ME(MongoClient, getResolverStats);
+    HHVM_STATIC_ME(MongoClient, getWireStats);
 }
 
 } //namespace HPHP
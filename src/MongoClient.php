@@ -14,7 +14,24 @@ class MongoClient {
 
   private $read_preference = [];
   private $databases = [];
+  private $written_namespaces = [];
 
+  /**
+   * Creates a new database connection object
+   *
+   * @param string $server - server    The server name. A co-located
+   *   server may be reached over a Unix domain socket, with the
+   *   URL-encoded path of a file ending in .sock as the host, e.g.
+   *   mongodb://%2Ftmp%2Fmongodb-27017.sock.
+   * @param array $options - options    Besides the connection string
+   *   options: "username", "password" and "db" (the authentication
+   *   database, default "admin"); "compressors" (a list or comma-separated
+   *   string of snappy, zlib and zstd, in order of preference, negotiated
+   *   with the server; needs libmongoc 1.9 built with them) and
+   *   "zlibCompressionLevel" (-1 to 9).
+   *
+   * @return - Returns a new database connection object.
+   */
   <<__Native>>
   public function __construct (string $server = "mongodb://localhost:27017", 
                                 array $options = array('connect' => true)): void;
@@ -127,6 +144,21 @@ class MongoClient {
     return $this->selectDB('admin')->command(array("listDatabases" => 1));
   }
 
+  /**
+   * Returns the namespaces written through this client
+   *
+   * Reads from these namespaces are sent to the primary whatever their
+   * read preference, so a request reads its own writes. The client object
+   * lives for at most one request, and so does this list.
+   *
+   * @return array - Returns the namespaces, mapped to the optime of the
+   *   last write as a MongoTimestamp where the server reported one, or
+   *   TRUE.
+   */
+  public function getWrittenNamespaces(): array {
+    return $this->written_namespaces;
+  }
+
   /**
    * Gets a database collection
    *
@@ -184,4 +216,47 @@ class MongoClient {
    */
   <<__Native>>
   public function getServerVersion(): string;
+
+  /**
+   * Sets how host names of persistent connections are resolved
+   *
+   * Resolutions are cached for the whole process. Once an entry expires it
+   * is still used while it is resolved again in the background, so
+   * reconnecting does not wait on DNS; a failed refresh keeps the last
+   * addresses. Connections using TLS or Unix domain sockets bypass the
+   * cache.
+   *
+   * @param array $options - options    "enabled" (default TRUE), "ttl"
+   *   (milliseconds a resolution is fresh, default 60000) and
+   *   "negativeTtl" (milliseconds a failure is remembered, default 5000).
+   *
+   * @return void
+   */
+  <<__Native>>
+  public static function configureResolver(array $options): void;
+
+  /**
+   * Returns counters of the host name cache
+   *
+   * @return array - Returns "entries", "hits", "misses", "staleHits",
+   *   "negativeHits", "refreshes" and "refreshFailures".
+   */
+  <<__Native>>
+  public static function getResolverStats(): array;
+
+  /**
+   * Returns wire protocol byte counters of persistent connections
+   *
+   * Compressed messages count at their size on the wire in "bytesIn" and
+   * "bytesOut", and at their original size in the "Uncompressed"
+   * counters, so the ratio shows what compression saves.
+   *
+   * @return array - Returns "bytesOut", "bytesOutUncompressed",
+   *   "bytesIn", "bytesInUncompressed", "messagesOut", "messagesIn",
+   *   "compressedOut", "compressedIn", and the connections opened over
+   *   TCP ("connectionsTcp") and Unix domain sockets ("connectionsUnix")
+   *   and those that failed ("connectFailures").
+   */
+  <<__Native>>
+  public static function getWireStats(): array;
 }
\ No newline at end of file
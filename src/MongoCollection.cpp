@@ -1,7 +1,24 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 #include "ext_mongo.h"
 #include "bson_decode.h"
+#include "mongo_counters.h"
+#include "mongo_metadata_cache.h"
+#include "mongo_spool.h"
+#include "mongo_write_queue.h"
 #include "contrib/encode.h"
 
+// stdio buffer used by dumpTo(); large enough to coalesce a full batch of
+// small documents into a single write(2)
+#define MONGO_DUMP_BUFFER_SIZE (1024 * 1024)
+
+// restoreFrom() sends a bulk insert once either limit is reached
+#define MONGO_RESTORE_BATCH_DOCS 1000
+#define MONGO_RESTORE_BATCH_BYTES (16 * 1024 * 1024)
+
 namespace HPHP {
 
     static ObjectData *
@@ -32,6 +49,40 @@ namespace HPHP {
         return collection;
     }
 
+    static bool spool_namespace(const Object& obj, std::string *uri, std::string *ns) {
+        auto db = obj->o_realProp("db", ObjectData::RealPropUnchecked, "MongoCollection")->toObject();
+        auto client = db->o_realProp("client", ObjectData::RealPropUnchecked, "MongoDB")->toObject();
+        String db_name = db->o_realProp("db_name", ObjectData::RealPropUnchecked, "MongoDB")->toString();
+        String collection_name = obj->o_realProp("name", ObjectData::RealPropUnchecked, "MongoCollection")->toString();
+
+        *uri = get_client(client)->uri();
+        *ns = db_name.toCppString() + "." + collection_name.toCppString();
+        return mongo_spool_enabled(*uri, *ns);
+    }
+
+    // Records on the MongoClient, which lives for at most one request, that
+    // the namespace was written. Reads that may go to a secondary are sent
+    // to the primary afterwards; see MongoCursor::rewind().
+    static void track_write(const Object& obj, mongoc_collection_t *collection) {
+        auto db = obj->o_realProp("db", ObjectData::RealPropUnchecked, "MongoCollection")->toObject();
+        auto client = db->o_realProp("client", ObjectData::RealPropUnchecked, "MongoDB")->toObject();
+        String db_name = db->o_realProp("db_name", ObjectData::RealPropUnchecked, "MongoDB")->toString();
+        String collection_name = obj->o_realProp("name", ObjectData::RealPropUnchecked, "MongoCollection")->toString();
+
+        // The optime of the write, where the server reports one
+        Variant optime = true;
+        const bson_t *last_error = mongoc_collection_get_last_error(collection);
+        bson_iter_t iter;
+        if (last_error && bson_iter_init_find(&iter, last_error, "lastOp") &&
+            BSON_ITER_HOLDS_TIMESTAMP(&iter)) {
+            optime = cbson_loads_value(&iter);
+        }
+
+        Array written = client->o_realProp("written_namespaces", ObjectData::RealPropUnchecked, "MongoClient")->toArray();
+        written.set(db_name + "." + collection_name, optime);
+        client->o_set("written_namespaces", written, "MongoClient");
+    }
+
     ////////////////////////////////////////////////////////////////////////////////
     // class MongoCollection
 
@@ -80,12 +131,36 @@ namespace HPHP {
         write_concern = mongoc_write_concern_new();
         mongoc_write_concern_set_w(write_concern, w_flag);
         
-        bool ret = mongoc_collection_insert(collection, MONGOC_INSERT_NONE, &doc, write_concern, &error);
-        if (!ret) {
-            mongoThrow<MongoCursorException>((const char *) error.message);
+        // Spooled namespaces keep writing to the spool until it has been
+        // replayed, so documents reach the server in order
+        std::string uri, ns;
+        bool spooled = spool_namespace(this_, &uri, &ns);
+        bool ret = false;
+        bool attempted = !spooled || !mongo_spool_pending(uri, ns);
+        if (attempted) {
+            ret = mongoc_collection_insert(collection, MONGOC_INSERT_NONE, &doc, write_concern, &error);
+            if (ret) {
+                track_write(this_, collection);
+            }
         }
+        // Only documents that could not reach a primary are spooled; the
+        // server rejecting one, e.g. for a duplicate key, still throws
+        if (!ret && spooled && (!attempted || is_connectivity_error(error))) {
+            std::string spool_error;
+            ret = mongo_spool_append(uri, ns, &doc, &spool_error);
+            if (!ret) {
+                // Not a server error, whatever the failed insert reported
+                error.domain = 0;
+                error.code = 0;
+                bson_strncpy(error.message, spool_error.c_str(), sizeof(error.message));
+            }
+        }
+        mongoc_write_concern_destroy(write_concern);
         mongoc_collection_destroy(collection);
         bson_destroy(&doc);
+        if (!ret) {
+            mongoThrowError(error);
+        }
         return ret;
         /*
         bool mongoc_collection_insert (mongoc_collection_t           *collection,
@@ -135,8 +210,9 @@ namespace HPHP {
         bool ret = mongoc_collection_delete(collection, delete_flag, &criteria_b, write_concern, &error);
 
         if (!ret) {
-            mongoThrow<MongoCursorException>((const char *) error.message);
+            mongoThrowError(error);
         }
+        track_write(this_, collection);
         mongoc_collection_destroy(collection);
         bson_destroy(&criteria_b);
         
@@ -192,8 +268,9 @@ namespace HPHP {
         bson_destroy(&update);
         bson_destroy(&selector);
         if (!ret) {
-            mongoThrow<MongoCursorException>((const char *) error.message);
+            mongoThrowError(error);
         }
+        track_write(this_, collection);
         collection_error = mongoc_collection_get_last_error(collection);
         //char *str;
         //if (collection_error) {
@@ -228,12 +305,332 @@ namespace HPHP {
     }
 
 
+    /**
+     * Writes the documents matching a query to a file as concatenated BSON
+     *
+     * @param string $path - path    File to write. The output has the same
+     *   layout as a mongodump .bson file.
+     * @param array $query - query    The fields for which to search.
+     *
+     * @return int - Returns the number of documents written.
+     */
+    //public function dumpTo(string $path, array $query = array()): int;
+
+    static int64_t HHVM_METHOD(MongoCollection, dumpTo, const String& path, Array query) {
+        mongoc_collection_t *collection;
+        mongoc_cursor_t *cursor;
+        const bson_t *doc;
+        bson_t query_bs;
+        bson_error_t error;
+        int64_t count = 0;
+        bool write_failed = false;
+
+        FILE *fp = fopen(path.c_str(), "wb");
+        if (fp == nullptr) {
+            mongoThrow<MongoException>(("Unable to open " + path + " for writing").c_str());
+        }
+        setvbuf(fp, nullptr, _IOFBF, MONGO_DUMP_BUFFER_SIZE);
+
+        collection = get_collection(this_);
+        encodeToBSON(query, &query_bs);
+        cursor = mongoc_collection_find(collection, MONGOC_QUERY_NONE, 0, 0, 0, &query_bs, nullptr, nullptr);
+
+        // The reply buffer is written out as-is; documents are never decoded
+        while (mongoc_cursor_next(cursor, &doc)) {
+            if (fwrite(bson_get_data(doc), 1, doc->len, fp) != doc->len) {
+                write_failed = true;
+                break;
+            }
+            count++;
+        }
+
+        bool cursor_failed = mongoc_cursor_error(cursor, &error);
+        mongoc_cursor_destroy(cursor);
+        mongoc_collection_destroy(collection);
+        bson_destroy(&query_bs);
+
+        if (fclose(fp) != 0) {
+            write_failed = true;
+        }
+        if (cursor_failed) {
+            mongoThrowError(error);
+        }
+        if (write_failed) {
+            mongoThrow<MongoException>(("Unable to write to " + path).c_str());
+        }
+        return count;
+    }
+
+    /**
+     * Inserts every document of a concatenated BSON file into the collection
+     *
+     * @param string $path - path    File to read, such as one written by
+     *   MongoCollection::dumpTo() or mongodump.
+     *
+     * @return int - Returns the number of documents inserted.
+     */
+    //public function restoreFrom(string $path): int;
+
+    static int64_t HHVM_METHOD(MongoCollection, restoreFrom, const String& path) {
+        mongoc_collection_t *collection;
+        mongoc_write_concern_t *write_concern;
+        bson_reader_t *reader;
+        const bson_t *doc;
+        bson_error_t error;
+        struct stat st;
+        bool reached_eof = false;
+        bool insert_failed = false;
+        int64_t count = 0;
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            mongoThrow<MongoException>(("Unable to open " + path + " for reading").c_str());
+        }
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return 0;
+        }
+
+        void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            mongoThrow<MongoException>(("Unable to map " + path).c_str());
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+        collection = get_collection(this_);
+        write_concern = mongoc_write_concern_new();
+        mongoc_write_concern_set_w(write_concern, MONGOC_WRITE_CONCERN_W_DEFAULT);
+        reader = bson_reader_new_from_data((const uint8_t *) data, st.st_size);
+
+        // The reader hands back the same bson_t for every document, so each
+        // batch entry is a static bson_t pointing straight into the mapping
+        std::vector<bson_t> batch(MONGO_RESTORE_BATCH_DOCS);
+        std::vector<const bson_t *> batch_ptrs(MONGO_RESTORE_BATCH_DOCS);
+        uint32_t batch_docs = 0;
+        size_t batch_bytes = 0;
+
+        auto flush = [&]() {
+            if (batch_docs == 0) {
+                return true;
+            }
+            bool ok = mongoc_collection_insert_bulk(collection, MONGOC_INSERT_NONE,
+                batch_ptrs.data(), batch_docs, write_concern, &error);
+            if (ok) {
+                count += batch_docs;
+            }
+            batch_docs = 0;
+            batch_bytes = 0;
+            return ok;
+        };
+
+        while ((doc = bson_reader_read(reader, &reached_eof))) {
+            bson_init_static(&batch[batch_docs], bson_get_data(doc), doc->len);
+            batch_ptrs[batch_docs] = &batch[batch_docs];
+            batch_docs++;
+            batch_bytes += doc->len;
+
+            if (batch_docs == MONGO_RESTORE_BATCH_DOCS ||
+                batch_bytes >= MONGO_RESTORE_BATCH_BYTES) {
+                if (!flush()) {
+                    insert_failed = true;
+                    break;
+                }
+            }
+        }
+        if (!insert_failed && !flush()) {
+            insert_failed = true;
+        }
+
+        bson_reader_destroy(reader);
+        mongoc_write_concern_destroy(write_concern);
+        mongoc_collection_destroy(collection);
+        munmap(data, st.st_size);
+
+        if (insert_failed) {
+            mongoThrowError(error);
+        }
+        if (!reached_eof) {
+            mongoThrow<MongoException>("Unexpected end of BSON. Input document is likely corrupted!");
+        }
+        return count;
+    }
+
+
+    /**
+     * Queues a document for insertion by a background driver thread
+     *
+     * @param array|object $a - a    The document to insert.
+     *
+     * @return bool - Returns TRUE if the document was queued or spilled,
+     *   FALSE if it was dropped.
+     */
+    //public function insertAsync(mixed $a): bool;
+
+    static bool HHVM_METHOD(MongoCollection, insertAsync, const Variant& a) {
+        auto db = this_->o_realProp("db", ObjectData::RealPropUnchecked, "MongoCollection")->toObject();
+        auto client = db->o_realProp("client", ObjectData::RealPropUnchecked, "MongoDB")->toObject();
+        String db_name = db->o_realProp("db_name", ObjectData::RealPropUnchecked, "MongoDB")->toString();
+        String collection_name = this_->o_realProp("name", ObjectData::RealPropUnchecked, "MongoCollection")->toString();
+        bson_t doc;
+
+        encodeToBSON(a, &doc);
+        bool ret = mongo_write_queue_push(get_client(client)->uri(),
+                                          db_name.toCppString() + "." + collection_name.toCppString(),
+                                          &doc);
+        bson_destroy(&doc);
+        return ret;
+    }
+
+    /**
+     * Adds a delta to a numeric field through the process-wide counter table
+     *
+     * @param mixed $id - id    The _id of the document to update. It is
+     *   upserted if missing.
+     * @param string $field - field    The field to increment.
+     * @param int|float $delta - delta    The amount to add.
+     *
+     * @return void
+     */
+    //public function increment(mixed $id, string $field, mixed $delta = 1): void;
+
+    static void HHVM_METHOD(MongoCollection, increment, const Variant& id, const String& field, const Variant& delta) {
+        auto db = this_->o_realProp("db", ObjectData::RealPropUnchecked, "MongoCollection")->toObject();
+        auto client = db->o_realProp("client", ObjectData::RealPropUnchecked, "MongoDB")->toObject();
+        String db_name = db->o_realProp("db_name", ObjectData::RealPropUnchecked, "MongoDB")->toString();
+        String collection_name = this_->o_realProp("name", ObjectData::RealPropUnchecked, "MongoCollection")->toString();
+
+        if (!delta.isInteger() && !delta.isDouble()) {
+            mongoThrow<MongoException>("increment() expects an integer or float delta");
+        }
+
+        Array selector = Array::Create();
+        selector.set(String("_id"), id);
+        bson_t id_bs;
+        encodeToBSON(selector, &id_bs);
+
+        std::string ns = db_name.toCppString() + "." + collection_name.toCppString();
+        std::string error;
+        bool ok;
+        if (delta.isDouble()) {
+            ok = mongo_counters_add(get_client(client)->uri(), ns, &id_bs, field.toCppString(), delta.toDouble(), &error);
+        } else {
+            ok = mongo_counters_add(get_client(client)->uri(), ns, &id_bs, field.toCppString(), delta.toInt64(), &error);
+        }
+        bson_destroy(&id_bs);
+
+        // Only increments written through fail here, as flushCounters() does
+        if (!ok) {
+            mongoThrow<MongoCursorException>(error.c_str());
+        }
+    }
+
+    /**
+     * Sets how coalesced increments are written
+     *
+     * @param array $options - options    "flushInterval" (milliseconds
+     *   between background flushes; 0 writes each increment through),
+     *   "maxPending" (pending document fields that trigger an early
+     *   flush), "w" (write concern of the flushes) and "retry" (keep the
+     *   deltas of a failed flush for the next one).
+     *
+     * @return void
+     */
+    //public static function configureCounters(array $options): void;
+
+    static void HHVM_STATIC_METHOD(MongoCollection, configureCounters, const Array& options) {
+        MongoCounterOptions counter_options = mongo_counters_options();
+
+        if (options.exists(String("flushInterval"))) {
+            counter_options.flush_interval_ms = options[String("flushInterval")].toInt64();
+        }
+        if (options.exists(String("maxPending"))) {
+            counter_options.max_pending = options[String("maxPending")].toInt64();
+        }
+        if (options.exists(String("w"))) {
+            counter_options.w = options[String("w")].toInt32();
+        }
+        if (options.exists(String("retry"))) {
+            counter_options.retry_failed = options[String("retry")].toBoolean();
+        }
+        mongo_counters_configure(counter_options);
+    }
+
+    /**
+     * Writes all pending increments now
+     *
+     * @return int - Returns the number of documents updated.
+     */
+    //public static function flushCounters(): int;
+
+    static int64_t HHVM_STATIC_METHOD(MongoCollection, flushCounters) {
+        std::string error;
+        int64_t updated = mongo_counters_flush(&error);
+
+        if (!error.empty()) {
+            mongoThrow<MongoCursorException>(error.c_str());
+        }
+        return updated;
+    }
+
+    /**
+     * Returns information about indexes on this collection
+     *
+     * @return array - This function returns an array in which each element
+     *   describes an index.
+     */
+    //public function getIndexInfo(): array;
+
+    static Array HHVM_METHOD(MongoCollection, getIndexInfo) {
+        std::string uri, ns;
+        spool_namespace(this_, &uri, &ns);
+
+        MongoMetadata docs = mongo_metadata_cache_get(uri, ns);
+        if (!docs) {
+            // libmongoc falls back to system.indexes on servers without the
+            // listIndexes command
+            mongoc_collection_t *collection = get_collection(this_);
+            bson_error_t error;
+            mongoc_cursor_t *cursor = mongoc_collection_find_indexes(collection, &error);
+
+            if (cursor) {
+                docs = mongo_metadata_from_cursor(cursor, &error);
+                mongoc_cursor_destroy(cursor);
+            }
+            mongoc_collection_destroy(collection);
+
+            if (!docs) {
+                // A collection that does not exist has no indexes
+                if (error.code != 26) {
+                    mongoThrowError(error);
+                }
+                docs = std::make_shared<std::vector<std::string>>();
+            }
+            mongo_metadata_cache_put(uri, ns, docs);
+        }
+
+        Array ret = Array::Create();
+        for (auto& data : *docs) {
+            bson_t doc;
+            bson_init_static(&doc, (const uint8_t *) data.data(), data.size());
+            ret.append(cbson_loads(&doc));
+        }
+        return ret;
+    }
+
     ////////////////////////////////////////////////////////////////////////////////
 
     void MongoExtension::_initMongoCollectionClass() {
         HHVM_ME(MongoCollection, insert);
         HHVM_ME(MongoCollection, remove);
         HHVM_ME(MongoCollection, update);
+        HHVM_ME(MongoCollection, dumpTo);
+        HHVM_ME(MongoCollection, restoreFrom);
+        HHVM_ME(MongoCollection, insertAsync);
+        HHVM_ME(MongoCollection, increment);
+        HHVM_ME(MongoCollection, getIndexInfo);
+        HHVM_STATIC_ME(MongoCollection, configureCounters);
+        HHVM_STATIC_ME(MongoCollection, flushCounters);
     }
 
 } // namespace HPHP
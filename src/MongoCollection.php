@@ -72,6 +72,91 @@ class MongoCollection {
                          array $options = array()): mixed;
 
 
+  /**
+   * Writes the documents matching a query to a file as concatenated BSON
+   *
+   * @param string $path - path    File to write. The output has the same
+   *   layout as a mongodump .bson file.
+   * @param array $query - query    The fields for which to search.
+   *
+   * @return int - Returns the number of documents written.
+   */
+  <<__Native>>
+  public function dumpTo(string $path,
+                         array $query = array()): int;
+
+  /**
+   * Inserts every document of a concatenated BSON file into this collection
+   *
+   * @param string $path - path    File to read, such as one written by
+   *   MongoCollection::dumpTo() or mongodump. The file is memory-mapped and
+   *   documents are sent in bulk inserts without being decoded.
+   *
+   * @return int - Returns the number of documents inserted.
+   */
+  <<__Native>>
+  public function restoreFrom(string $path): int;
+
+  /**
+   * Queues a document for insertion by a background driver thread
+   *
+   * The call returns without waiting for the server. Documents are
+   * inserted in unordered batches; without an _id, the server assigns
+   * one. See MongoWriteQueue for backpressure and counters.
+   *
+   * @param array|object $a - a    The document to insert.
+   *
+   * @return bool - Returns TRUE if the document was queued or spilled,
+   *   FALSE if it was dropped because the queue was full.
+   */
+  <<__Native>>
+  public function insertAsync(mixed $a): bool;
+
+  /**
+   * Adds a delta to a numeric field through the process-wide counter table
+   *
+   * Deltas for the same document and field are summed in memory and
+   * written by a background thread as one bulk of $inc upserts per flush
+   * interval, when too many are pending, or at shutdown. Increments are
+   * not visible to reads until flushed; see configureCounters().
+   *
+   * @param mixed $id - id    The _id of the document to update. It is
+   *   upserted if missing.
+   * @param string $field - field    The field to increment.
+   * @param int|float $delta - delta    The amount to add.
+   *
+   * @return void - Throws MongoCursorException if the increment was
+   *   written through and failed.
+   */
+  <<__Native>>
+  public function increment(mixed $id,
+                            string $field,
+                            mixed $delta = 1): void;
+
+  /**
+   * Sets how coalesced increments are written
+   *
+   * @param array $options - options    "flushInterval" (milliseconds
+   *   between background flushes, default 1000; 0 writes each increment
+   *   through), "maxPending" (pending document fields that trigger an
+   *   early flush, default 10000), "w" (write concern of the flushes) and
+   *   "retry" (keep the deltas of a failed flush for the next one, which
+   *   may count a partially applied bulk twice; default TRUE).
+   *
+   * @return void
+   */
+  <<__Native>>
+  public static function configureCounters(array $options): void;
+
+  /**
+   * Writes all pending increments now
+   *
+   * @return int - Returns the number of documents updated.
+   */
+  <<__Native>>
+  public static function flushCounters(): int;
+
+
   private function getFullName(): string {
     return $this->db . "." . $this->name;
    }
@@ -184,7 +269,9 @@ class MongoCollection {
    */
   public function deleteIndex(mixed $keys): array {
     $index = $this->toIndexString($keys);
-    return $this->db->command(array("deleteIndexes" => $this->getName(), "index" => $index));
+    $result = $this->db->command(array("deleteIndexes" => $this->getName(), "index" => $index));
+    MongoDB::clearMetadataCache($this->db);
+    return $result;
   }
 
   /**
@@ -215,7 +302,9 @@ class MongoCollection {
    * @return array - Returns the database response.
    */
   public function drop(): array {
-    return $this->db->command(array("drop" => $this->name));
+    $result = $this->db->command(array("drop" => $this->name));
+    MongoDB::clearMetadataCache($this->db);
+    return $result;
   }
 
   /**
@@ -268,6 +357,7 @@ class MongoCollection {
     } else {
       $out = $this->db->selectCollection("system.indexes")->insert($indexOptions, 0, true);
     }
+    MongoDB::clearMetadataCache($this->db);
     return $out;
   }
 
@@ -346,7 +436,7 @@ class MongoCollection {
    * @return MongoCollection - Returns the collection.
    */
   public function __get(string $name): MongoCollection {
-    return $this->db->selectCollection($name);
+    return $this->db->selectCollection($this->name . "." . $name);
   }
 
   /**
@@ -364,15 +454,17 @@ class MongoCollection {
   /**
    * Returns information about indexes on this collection
    *
+   * Uses the listIndexes command. Results are shared by all requests of
+   * the process while MongoDB::setMetadataCacheTTL() allows.
+   *
    * @return array - This function returns an array in which each element
    *   describes an index. Elements will contain the values name for the
    *   name of the index, ns for the namespace (a combination of the
    *   database and collection name), and key for a list of all fields in
    *   the index and their ordering.
    */
-  public function getIndexInfo(): array {
-    return $this->db->selectCollection("system.indexes")->findOne(array("ns" => $this->getFullName()));
-  }
+  <<__Native>>
+  public function getIndexInfo(): array;
 
   /**
    * Returns this collections name
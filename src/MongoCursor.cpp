@@ -1,10 +1,27 @@
 #include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
 #include "ext_mongo.h"
+#include "bson_compare.h"
 #include "bson_decode.h"
 #include "contrib/encode.h"
 
 namespace HPHP {
 
+const StaticString
+  s_mongo_decode_options("__mongo_decode_options");
+
+static BSONDecodeOptions *get_decode_options(Object obj) {
+  auto res = obj->o_realProp(s_mongo_decode_options, ObjectData::RealPropUnchecked, s_mongocursor);
+
+  if (!res || !res->isResource()) {
+    return nullptr;
+  }
+  return res->toResource().getTyped<BSONDecodeOptions>(true, false);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // class MongoCursor
 
@@ -23,9 +40,13 @@ static Variant HHVM_METHOD(MongoCursor, current) {
   doc = mongoc_cursor_current(cursor);
   bson_error_t error;
   if (mongoc_cursor_error (cursor, &error)) {
-    mongoThrow<MongoCursorException>((const char *)error.message);
+    mongoThrowError(error);
   }
   if (doc) {
+    auto options = get_decode_options(this_);
+    if (options) {
+      return cbson_loads(doc, options->get());
+    }
     auto ret = cbson_loads(doc);  
     return ret;   
   } else {
@@ -39,7 +60,7 @@ static bool HHVM_METHOD(MongoCursor, hasNext) {
 
   bool ret = mongoc_cursor_more(cursor);
   if (mongoc_cursor_error (cursor, &error)) {
-    mongoThrow<MongoCursorException>((const char *)error.message);
+    mongoThrowError(error);
   } 
   return ret;
 }
@@ -58,7 +79,7 @@ static void HHVM_METHOD(MongoCursor, next) {
   mongoc_cursor_next (cursor, &doc);   //Note: error would be catched by valid()
   bson_error_t error;
   if (mongoc_cursor_error (cursor, &error)) {
-    mongoThrow<MongoCursorException>((const char *)error.message);
+    mongoThrowError(error);
   }
   
   auto at = this_->o_realProp("at", ObjectData::RealPropUnchecked, "MongoCursor")->toInt64();
@@ -142,6 +163,14 @@ MongocCursor(mongoc_client_t           *client,
   if (flags_array->exists((int64_t)6)) { flags = (flags | MONGOC_QUERY_EXHAUST);}
   if (flags_array->exists((int64_t)7)) { flags = (flags | MONGOC_QUERY_PARTIAL);}
 
+  // tailable() and awaitData() are kept apart from the raw flags
+  if (this_->o_realProp("tailable", ObjectData::RealPropUnchecked, "MongoCursor")->toBoolean()) {
+    flags |= MONGOC_QUERY_TAILABLE_CURSOR;
+    if (this_->o_realProp("wait", ObjectData::RealPropUnchecked, "MongoCursor")->toBoolean()) {
+      flags |= MONGOC_QUERY_AWAIT_DATA;
+    }
+  }
+
   uint32_t skip = this_->o_realProp("skip", ObjectData::RealPropUnchecked, "MongoCursor")->toInt32();
   uint32_t limit = this_->o_realProp("limit", ObjectData::RealPropUnchecked, "MongoCursor")->toInt32();
   uint32_t batchSize = this_->o_realProp("batchSize", ObjectData::RealPropUnchecked, "MongoCursor")->toInt32();
@@ -171,6 +200,17 @@ MongocCursor(mongoc_client_t           *client,
     mongoc_read_prefs_set_mode(read_prefs, MONGOC_READ_NEAREST);
   }
   mongoc_read_prefs_set_tags(read_prefs, &read_prefs_tags_bs);
+
+  // Read your own writes: once this request wrote the namespace through
+  // the same client, secondaries may not have caught up yet. libmongoc
+  // cannot select members by optime, so such reads go to the primary.
+  if (mongoc_read_prefs_get_mode(read_prefs) != MONGOC_READ_PRIMARY) {
+    auto written = connection->o_realProp("written_namespaces", ObjectData::RealPropUnchecked, "MongoClient")->toArray();
+    if (written.exists(ns)) {
+      mongoc_read_prefs_set_mode(read_prefs, MONGOC_READ_PRIMARY);
+      mongoc_read_prefs_set_tags(read_prefs, nullptr);
+    }
+  }
   
    encodeToBSON(fields,&fields_bs);
 
@@ -186,11 +226,19 @@ MongocCursor(mongoc_client_t           *client,
   
   bson_error_t error;
   if (mongoc_cursor_error (cursor->get(), &error)) {
-    mongoThrow<MongoCursorException>((const char *)error.message);
+    mongoThrowError(error);
   }
   
   this_->o_set(s_mongoc_cursor, cursor, s_mongocursor);
   bson_destroy(&query_bs);
+
+  // Decode options are compiled once per iteration rather than per document
+  auto decode_options = this_->o_realProp("decode_options", ObjectData::RealPropUnchecked, "MongoCursor")->toArray();
+  if (decode_options.empty()) {
+    this_->o_set(s_mongo_decode_options, init_null_variant, s_mongocursor);
+  } else {
+    this_->o_set(s_mongo_decode_options, new BSONDecodeOptions(decode_options), s_mongocursor);
+  }
   bson_destroy(&fields_bs);
   bson_destroy(&read_prefs_tags_bs);
 
@@ -204,6 +252,348 @@ static bool HHVM_METHOD(MongoCursor, valid) {
   return ! cur.isNull();
 }
 
+// Returns the first document not yet handed out, or null. The current
+// document is the last one handed out, except right after the rewind that
+// opens the cursor.
+static const bson_t *mongo_cursor_first_unread(const Object& this_,
+                                               mongoc_cursor_t **cursor) {
+  const bson_t *doc = nullptr;
+  bool started = this_->o_realProp("started_iterating", ObjectData::RealPropUnchecked, "MongoCursor")->toBoolean();
+
+  if (!started) {
+    HHVM_MN(MongoCursor, rewind)(this_);
+  }
+  *cursor = get_cursor(this_)->get();
+  if (!started) {
+    doc = mongoc_cursor_current(*cursor);
+  } else if (!mongoc_cursor_next(*cursor, &doc)) {
+    doc = nullptr;
+  }
+  return doc;
+}
+
+// Hands every document not yet handed out to fn as raw BSON, leaving the
+// cursor exhausted. Documents are only valid during the call.
+template <typename F>
+static void mongo_cursor_drain(const Object& this_, F fn) {
+  mongoc_cursor_t *cursor;
+  const bson_t *doc = mongo_cursor_first_unread(this_, &cursor);
+  int64_t drained = 0;
+
+  while (doc) {
+    fn(doc);
+    if (!mongoc_cursor_next(cursor, &doc)) {
+      doc = nullptr;
+    }
+    drained++;
+  }
+
+  bson_error_t error;
+  if (mongoc_cursor_error(cursor, &error)) {
+    mongoThrowError(error);
+  }
+
+  auto at = this_->o_realProp("at", ObjectData::RealPropUnchecked, "MongoCursor")->toInt64();
+  this_->o_set("at", at + drained, "MongoCursor");
+}
+
+static Array HHVM_METHOD(MongoCursor, toColumns, const Array& field_paths, const Variant& default_value) {
+  std::vector<std::string> paths;
+  std::vector<Array> columns;
+
+  for (ArrayIter it(field_paths); it; ++it) {
+    paths.push_back(it.second().toString().toCppString());
+    columns.push_back(Array::Create());
+  }
+
+  // Only the requested paths are located and decoded; each column is a
+  // packed array appended to in document order
+  mongo_cursor_drain(this_, [&](const bson_t *doc) {
+    bson_iter_t root, value;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+      if (bson_iter_init(&root, doc) &&
+          bson_iter_find_descendant(&root, paths[i].c_str(), &value)) {
+        columns[i].append(cbson_loads_value(&value));
+      } else {
+        columns[i].append(default_value);
+      }
+    }
+  });
+
+  Array ret = Array::Create();
+  for (size_t i = 0; i < paths.size(); i++) {
+    ret.set(String(paths[i]), columns[i]);
+  }
+  return ret;
+}
+
+static Array HHVM_METHOD(MongoCursor, fetchBatch, int64_t max) {
+  auto options = get_decode_options(this_);
+  Array ret = Array::Create();
+  mongoc_cursor_t *cursor;
+  const bson_t *doc = mongo_cursor_first_unread(this_, &cursor);
+
+  // Stops at max or at the first empty reply, so a tailable cursor returns
+  // after at most one await period without new documents
+  while (doc) {
+    ret.append(options ? cbson_loads(doc, options->get()) : Variant(cbson_loads(doc)));
+    if (ret.size() >= max || !mongoc_cursor_next(cursor, &doc)) {
+      break;
+    }
+  }
+
+  bson_error_t error;
+  if (mongoc_cursor_error(cursor, &error)) {
+    mongoThrowError(error);
+  }
+
+  auto at = this_->o_realProp("at", ObjectData::RealPropUnchecked, "MongoCursor")->toInt64();
+  this_->o_set("at", at + ret.size(), "MongoCursor");
+  return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Streaming aggregates
+
+enum class ReduceOp { Sum, Avg, Min, Max, Count, Distinct };
+
+struct ReduceField {
+  std::string alias;
+  ReduceOp op;
+  std::string path;
+};
+
+// Values that outlive a batch (group keys, min/max, distinct values) are
+// kept as a one-element BSON document holding just that value
+static std::string wrap_value(const bson_iter_t *iter) {
+  bson_t b;
+  bson_init(&b);
+  bson_append_iter(&b, "", 0, iter);
+  std::string raw((const char *) bson_get_data(&b), b.len);
+  bson_destroy(&b);
+  return raw;
+}
+
+static void unwrap_value(const std::string& raw, bson_iter_t *iter) {
+  bson_t b;
+  bson_init_static(&b, (const uint8_t *) raw.data(), raw.size());
+  bson_iter_init(iter, &b);
+  bson_iter_next(iter);
+}
+
+static Variant decode_wrapped(const std::string& raw) {
+  bson_iter_t iter;
+  unwrap_value(raw, &iter);
+  return cbson_loads_value(&iter);
+}
+
+// Group keys and distinct values are told apart the way the server does,
+// so int32 1, int64 1 and 1.0 are the same key, including inside documents
+struct WrappedValueLess {
+  bool operator()(const std::string& a, const std::string& b) const {
+    bson_iter_t a_iter, b_iter;
+    unwrap_value(a, &a_iter);
+    unwrap_value(b, &b_iter);
+    return cbson_compare_values(&a_iter, &b_iter) < 0;
+  }
+};
+
+struct ReduceAccumulator {
+  int64_t int_sum = 0;
+  double double_sum = 0;
+  bool is_double = false;
+  int64_t n = 0;
+  std::string extreme;
+  std::set<std::string, WrappedValueLess> seen;
+  std::vector<std::string> distinct;
+
+  void add(ReduceOp op, const bson_iter_t *value) {
+    switch (op) {
+    case ReduceOp::Sum:
+    case ReduceOp::Avg:
+      if (BSON_ITER_HOLDS_DOUBLE(value)) {
+        double_sum += bson_iter_double(value);
+        is_double = true;
+      } else if (BSON_ITER_HOLDS_INT32(value) || BSON_ITER_HOLDS_INT64(value)) {
+        int_sum += bson_iter_as_int64(value);
+      } else {
+        return;
+      }
+      n++;
+      break;
+    case ReduceOp::Min:
+    case ReduceOp::Max:
+    {
+      if (BSON_ITER_HOLDS_NULL(value) || BSON_ITER_HOLDS_UNDEFINED(value)) {
+        return;
+      }
+      if (!extreme.empty()) {
+        bson_iter_t current;
+        unwrap_value(extreme, &current);
+        int cmp = cbson_compare_values(value, &current);
+        if ((op == ReduceOp::Min && cmp >= 0) || (op == ReduceOp::Max && cmp <= 0)) {
+          return;
+        }
+      }
+      extreme = wrap_value(value);
+      break;
+    }
+    case ReduceOp::Distinct:
+    {
+      std::string raw = wrap_value(value);
+      if (seen.insert(raw).second) {
+        distinct.push_back(raw);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  Variant result(ReduceOp op) const {
+    switch (op) {
+    case ReduceOp::Sum:
+      return is_double ? Variant(double_sum + int_sum) : Variant(int_sum);
+    case ReduceOp::Avg:
+      return n ? Variant((double_sum + int_sum) / n) : init_null_variant;
+    case ReduceOp::Min:
+    case ReduceOp::Max:
+      return extreme.empty() ? init_null_variant : decode_wrapped(extreme);
+    case ReduceOp::Count:
+      return n;
+    case ReduceOp::Distinct:
+    {
+      Array values = Array::Create();
+      for (auto& raw : distinct) {
+        values.append(decode_wrapped(raw));
+      }
+      return values;
+    }
+    default:
+      return init_null_variant;
+    }
+  }
+};
+
+struct ReduceGroup {
+  std::string key;
+  std::vector<ReduceAccumulator> accumulators;
+};
+
+// Aggregation-style paths may be written with a leading "$"
+static std::string reduce_path(const Variant& path) {
+  std::string ret = path.toString().toCppString();
+  return (!ret.empty() && ret[0] == '$') ? ret.substr(1) : ret;
+}
+
+static void parse_reduce_spec(const Array& spec, std::string *group_by,
+                              std::vector<ReduceField> *fields) {
+  for (ArrayIter it(spec); it; ++it) {
+    String alias = it.first().toString();
+
+    if (alias == "_id") {
+      if (!it.second().isNull()) {
+        *group_by = reduce_path(it.second());
+      }
+      continue;
+    }
+
+    Array op_spec = it.second().toArray();
+    ArrayIter op(op_spec);
+    if (op_spec.size() != 1 || !op) {
+      mongoThrow<MongoException>(("reduce(): " + alias + " must map one operator to a field").c_str());
+    }
+
+    ReduceField field;
+    String name = op.first().toString();
+    field.alias = alias.toCppString();
+    field.path = reduce_path(op.second());
+
+    if (name == "$sum") {
+      field.op = ReduceOp::Sum;
+    } else if (name == "$avg") {
+      field.op = ReduceOp::Avg;
+    } else if (name == "$min") {
+      field.op = ReduceOp::Min;
+    } else if (name == "$max") {
+      field.op = ReduceOp::Max;
+    } else if (name == "$count") {
+      field.op = ReduceOp::Count;
+    } else if (name == "$distinct") {
+      field.op = ReduceOp::Distinct;
+    } else {
+      mongoThrow<MongoException>(("reduce(): unsupported operator " + name).c_str());
+    }
+    fields->push_back(field);
+  }
+}
+
+static Array HHVM_METHOD(MongoCursor, reduce, const Array& spec) {
+  std::string group_by;
+  std::vector<ReduceField> fields;
+  std::vector<ReduceGroup> groups;
+  std::map<std::string, size_t, WrappedValueLess> group_index;
+
+  parse_reduce_spec(spec, &group_by, &fields);
+
+  // Documents without the group-by field fall into the null group
+  const std::string null_group = [] {
+    bson_t b;
+    bson_init(&b);
+    bson_append_null(&b, "", 0);
+    std::string raw((const char *) bson_get_data(&b), b.len);
+    bson_destroy(&b);
+    return raw;
+  }();
+
+  mongo_cursor_drain(this_, [&](const bson_t *doc) {
+    bson_iter_t root, value;
+    std::string key = null_group;
+
+    if (!group_by.empty() && bson_iter_init(&root, doc) &&
+        bson_iter_find_descendant(&root, group_by.c_str(), &value)) {
+      key = wrap_value(&value);
+    }
+
+    auto found = group_index.find(key);
+    size_t index;
+    if (found == group_index.end()) {
+      index = groups.size();
+      group_index.emplace(key, index);
+      groups.push_back(ReduceGroup());
+      groups.back().key = key;
+      groups.back().accumulators.resize(fields.size());
+    } else {
+      index = found->second;
+    }
+
+    auto& accumulators = groups[index].accumulators;
+    for (size_t i = 0; i < fields.size(); i++) {
+      if (fields[i].op == ReduceOp::Count) {
+        accumulators[i].n++;
+        continue;
+      }
+      if (bson_iter_init(&root, doc) &&
+          bson_iter_find_descendant(&root, fields[i].path.c_str(), &value)) {
+        accumulators[i].add(fields[i].op, &value);
+      }
+    }
+  });
+
+  Array ret = Array::Create();
+  for (auto& group : groups) {
+    Array row = Array::Create();
+    row.set(String("_id"), group_by.empty() ? init_null_variant : decode_wrapped(group.key));
+    for (size_t i = 0; i < fields.size(); i++) {
+      row.set(String(fields[i].alias), group.accumulators[i].result(fields[i].op));
+    }
+    ret.append(row);
+  }
+  return ret;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 void MongoExtension::_initMongoCursorClass() {
@@ -213,6 +603,9 @@ void MongoExtension::_initMongoCursorClass() {
     HHVM_ME(MongoCursor, reset);
     HHVM_ME(MongoCursor, rewind);
     HHVM_ME(MongoCursor, valid);
+    HHVM_ME(MongoCursor, toColumns);
+    HHVM_ME(MongoCursor, reduce);
+    HHVM_ME(MongoCursor, fetchBatch);
 }
 
 } // namespace HPHP
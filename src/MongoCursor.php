@@ -11,6 +11,7 @@ class MongoCursor implements \Iterator {
   private $batchSize = 100;
   private $connection = null;
   private $dead = false;
+  private $decode_options = [];
   private $wait = true;
   private $fields = [];
   private $flags = [];
@@ -31,10 +32,11 @@ class MongoCursor implements \Iterator {
   /**
    * Returns the current element
    *
-   * @return array - The current result as an associative array.
+   * @return array - The current result as an associative array, or as
+   *   set by the cursor's decode options.
    */
   <<__Native>>
-  public function current(): ?array;
+  public function current(): mixed;
 
   /**
    * Checks if there are any more elements in this cursor.
@@ -77,6 +79,53 @@ class MongoCursor implements \Iterator {
   <<__Native>>
   public function valid(): bool;
 
+  /**
+   * Reads the remaining results into one array per field
+   *
+   * @param array $fieldPaths - fieldPaths    Dotted paths of the fields
+   *   to extract. No other field of a result is decoded.
+   * @param mixed $default - default    Value used for results that do
+   *   not contain a field.
+   *
+   * @return array - Returns an array mapping each path to a list holding
+   *   its value for every result, in cursor order. The cursor is left
+   *   exhausted.
+   */
+  <<__Native>>
+  public function toColumns(array $fieldPaths,
+                            mixed $default = null): array;
+
+  /**
+   * Computes aggregates over the remaining results in native code
+   *
+   * @param array $spec - spec    A $group-style specification. "_id"
+   *   optionally names the field path to group by; every other key names
+   *   an output field and maps one of $sum, $avg, $min, $max, $count or
+   *   $distinct to a field path, e.g. array("_id" => "country",
+   *   "total" => array('$sum' => "amount"), "n" => array('$count' => 1)).
+   *   Only the referenced fields of each result are read.
+   *
+   * @return array - Returns one row per group, in the order the groups
+   *   were first seen. The cursor is left exhausted.
+   */
+  <<__Native>>
+  public function reduce(array $spec): array;
+
+  /**
+   * Returns the next results in one call
+   *
+   * Reading stops at max results or when the server has no more to send.
+   * For a tailable cursor this returns after at most one await period
+   * without new documents. Do not mix with iterating the cursor.
+   *
+   * @param int $max - max    The maximum number of results to return.
+   *
+   * @return array - Returns the results, decoded as set by the cursor's
+   *   decode options. The array is empty if no results arrived.
+   */
+  <<__Native>>
+  public function fetchBatch(int $max = 100): array;
+
 
 
   //NON-NATIVE FUNCTIONS
@@ -231,6 +280,23 @@ class MongoCursor implements \Iterator {
     return $retval;
   }
 
+  /**
+   * Sets how the results are decoded
+   *
+   * @param array $options - options    The same options accepted by
+   *   bson_decode(), such as a "typemap". They are compiled once when the
+   *   cursor starts iterating.
+   *
+   * @return MongoCursor - Returns this cursor.
+   */
+  public function setDecodeOptions(array $options): MongoCursor {
+    if ($this->started_iterating) {
+      throw new MongoCursorException("Tried to add an option after started iterating");
+    }
+    $this->decode_options = $options;
+    return $this;
+  }
+
   /**
    * Sets the fields for a query
    *
@@ -252,7 +318,7 @@ class MongoCursor implements \Iterator {
    *
    * @return array - Returns the next object.
    */
-  public function getNext(): ?array {
+  public function getNext(): mixed {
       $this->next();
       return $this->current();
   }
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include "ext_mongo.h"
+#include "mongo_metadata_cache.h"
+
+namespace HPHP {
+
+const StaticString
+  s_mongodb("MongoDB");
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoDB
+
+static Array HHVM_METHOD(MongoDB, getCollectionNames, bool include_system_collections) {
+  auto client = get_client(this_->o_realProp("client", ObjectData::RealPropUnchecked, s_mongodb)->toObject());
+  std::string db_name = this_->o_realProp("db_name", ObjectData::RealPropUnchecked, s_mongodb)->toString().toCppString();
+
+  MongoMetadata docs = mongo_metadata_cache_get(client->uri(), db_name);
+  if (!docs) {
+    // libmongoc falls back to system.namespaces on servers without the
+    // listCollections command, stripping the database prefix
+    mongoc_database_t *database = mongoc_client_get_database(client->get(), db_name.c_str());
+    bson_error_t error;
+    mongoc_cursor_t *cursor = mongoc_database_find_collections(database, nullptr, &error);
+
+    if (cursor) {
+      docs = mongo_metadata_from_cursor(cursor, &error);
+      mongoc_cursor_destroy(cursor);
+    }
+    mongoc_database_destroy(database);
+
+    if (!docs) {
+      mongoThrowError(error);
+    }
+    mongo_metadata_cache_put(client->uri(), db_name, docs);
+  }
+
+  std::vector<std::string> names;
+  for (auto& data : *docs) {
+    bson_t doc;
+    bson_iter_t iter;
+    bson_init_static(&doc, (const uint8_t *) data.data(), data.size());
+
+    if (!bson_iter_init_find(&iter, &doc, "name") || !BSON_ITER_HOLDS_UTF8(&iter)) {
+      continue;
+    }
+    std::string name = bson_iter_utf8(&iter, nullptr);
+    if (!include_system_collections && name.compare(0, 7, "system.") == 0) {
+      continue;
+    }
+    names.push_back(std::move(name));
+  }
+  std::sort(names.begin(), names.end());
+
+  Array ret = Array::Create();
+  for (auto& name : names) {
+    ret.append(String(name));
+  }
+  return ret;
+}
+
+static Array HHVM_METHOD(MongoDB, authenticate, const String& username, const String& password) {
+  auto client_obj = this_->o_realProp("client", ObjectData::RealPropUnchecked, s_mongodb)->toObject();
+  String db_name = this_->o_realProp("db_name", ObjectData::RealPropUnchecked, s_mongodb)->toString();
+  String uri = String(uri_with_credentials(get_client(client_obj)->uri(), username.toCppString(),
+                                           password.toCppString(), db_name.toCppString()));
+
+  bool created;
+  MongocClient *client = get_persistent_client(uri, &created);
+  if (client == nullptr) {
+    mongoThrow<MongoConnectionException>("unable to bind credentials, Uri error");
+  }
+
+  Array ret = Array::Create();
+
+  // The persistent client for these credentials may have been created by
+  // MongoClient without ever talking to the server, so it is checked with
+  // a ping until one succeeds. A failed client stays cached, unverified,
+  // as other MongoClients may hold it.
+  if (!client->verified()) {
+    bson_t ping, reply;
+    bson_error_t error;
+
+    bson_init(&ping);
+    bson_append_int32(&ping, "ping", 4, 1);
+    bool ok = mongoc_client_command_simple(client->get(), db_name.c_str(), &ping, nullptr, &reply, &error);
+    bson_destroy(&ping);
+    bson_destroy(&reply);
+
+    if (!ok) {
+      ret.set(String("ok"), 0.0);
+      ret.set(String("errmsg"), String((const char *) error.message, CopyString));
+      ret.set(String("code"), (int64_t) error.code);
+      return ret;
+    }
+    client->setVerified();
+  }
+
+  client_obj->o_set(s_mongoc_client, client, s_mongoclient);
+  ret.set(String("ok"), 1.0);
+  return ret;
+}
+
+static void HHVM_STATIC_METHOD(MongoDB, setMetadataCacheTTL, int64_t ttl) {
+  mongo_metadata_cache_set_ttl(ttl);
+}
+
+static void HHVM_STATIC_METHOD(MongoDB, clearMetadataCache, const Variant& db) {
+  if (db.isNull()) {
+    mongo_metadata_cache_invalidate("", "");
+    return;
+  }
+
+  auto obj = db.toObject();
+  auto client = get_client(obj->o_realProp("client", ObjectData::RealPropUnchecked, s_mongodb)->toObject());
+  String db_name = obj->o_realProp("db_name", ObjectData::RealPropUnchecked, s_mongodb)->toString();
+  mongo_metadata_cache_invalidate(client->uri(), db_name.toCppString());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MongoExtension::_initMongoDBClass() {
+  HHVM_ME(MongoDB, authenticate);
+  HHVM_ME(MongoDB, getCollectionNames);
+  HHVM_STATIC_ME(MongoDB, setMetadataCacheTTL);
+  HHVM_STATIC_ME(MongoDB, clearMetadataCache);
+}
+
+} // namespace HPHP
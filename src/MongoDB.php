@@ -16,6 +16,12 @@ class MongoDB {
     /**
      * Log in to this database
      *
+     * The credentials are bound to the persistent connection, which
+     * authenticates each of its sockets once as it connects; later
+     * requests logging in with the same credentials reuse it without a
+     * round trip. The client uses the authenticated connection from then
+     * on.
+     *
      * @param string $username - username    The username.
      * @param string $password - password    The password (in plaintext).
      *
@@ -24,22 +30,9 @@ class MongoDB {
      *   return    ("auth fails" could be another message, depending on
      *   database version and what when wrong).
      */
+    <<__Native>>
     public function authenticate(string $username,
-                                string $password): array {
-        $salted = "${username}:mongo:${password}";
-        $hash = md5($salted);
-
-        $nonce = $this->command(array("getnonce" => 1));
-
-        $saltedHash = md5($nonce["nonce"]."${username}${hash}");
-        
-        $result = $this->command(array("authenticate" => 1,
-                                       "user" => $username,
-                                       "nonce" => $nonce["nonce"],
-                                       "key" => $saltedHash));
-
-        return $result;
-    }
+                                 string $password): array;
 
     /**
      * Execute a database command
@@ -96,6 +89,7 @@ class MongoDB {
             }
         }
         $result = $this->command($cmd);
+        self::clearMetadataCache($this);
         
         if (!$result["ok"]) {
             throw new MongoException("Unable to create collection");
@@ -133,7 +127,9 @@ class MongoDB {
      * @return array - Returns the database response.
      */
     public function drop(): array {
-        return $this->command(array("dropDatabase" => 1));
+        $result = $this->command(array("dropDatabase" => 1));
+        self::clearMetadataCache($this);
+        return $result;
     }
 
     /**
@@ -148,7 +144,9 @@ class MongoDB {
         if (is_object($coll)) {
             $coll = $coll->getName();
         }
-        return $this->command(array('drop' => $coll));
+        $result = $this->command(array('drop' => $coll));
+        self::clearMetadataCache($this);
+        return $result;
     }
 
     /**
@@ -192,32 +190,45 @@ class MongoDB {
         return $this->client;
     }
 
-    /** TODO: Handle system collections
+    /**
      * Get all collections from this database
      *
+     * Uses the listCollections command. Results are shared by all requests
+     * of the process while setMetadataCacheTTL() allows.
+     *
      * @param bool $includeSystemCollections -
      *
      * @return array - Returns the names of the all the collections in the
      *   database as an array.
      */
-    public function getCollectionNames(bool $includeSystemCollections = false): array {
-        $allCollections = [];
-        $db_name_length = strlen($this->db_name) + 1;
-        $c = $this->selectCollection("system.namespaces")->find();
-        while ($c->hasNext()) {
-            $c->next();
-            $curr_coll = $c->current();
-            $name = $curr_coll["name"];
-
-            if (strpos("$", $name) >= 0 && strpos(".oplog.$") === false) {
-                continue;
-            }
+    <<__Native>>
+    public function getCollectionNames(bool $includeSystemCollections = false): array;
 
-            $allCollections[] = substr($name, $db_name_length);
-        }
-        sort($allCollections);
-        return $allCollections;
-    }
+    /**
+     * Sets how long collection and index listings are cached
+     *
+     * The cache is shared by all requests of the process. Collections and
+     * indexes created or dropped through this driver invalidate it; changes
+     * made by other clients show once entries expire.
+     *
+     * @param int $ttl - ttl    Milliseconds an entry is kept, or 0 (the
+     *   default) to disable the cache.
+     *
+     * @return void
+     */
+    <<__Native>>
+    public static function setMetadataCacheTTL(int $ttl): void;
+
+    /**
+     * Discards cached collection and index listings
+     *
+     * @param MongoDB $db - db    The database whose listings to discard,
+     *   or NULL for all of them.
+     *
+     * @return void
+     */
+    <<__Native>>
+    public static function clearMetadataCache(?MongoDB $db = null): void;
 
     /**
      * Fetches the document pointed to by a database reference
@@ -286,7 +297,7 @@ class MongoDB {
      * @return array - Returns an array of MongoCollection objects.
      */
     public function listCollections(bool $includeSystemCollections = false): array {
-        $collection_names = $this->getCollectionNames();
+        $collection_names = $this->getCollectionNames($includeSystemCollections);
         foreach ($collection_names as $name) {
             if (!isset($this->collections[$name])) {
                 $this->collections[$name] = new MongoCollection($this, $name);
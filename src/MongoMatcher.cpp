@@ -0,0 +1,406 @@
+#include <string.h>
+#include <string>
+#include <vector>
+#include "ext_mongo.h"
+#include "bson_compare.h"
+#include "bson_decode.h"
+#include "contrib/encode.h"
+
+namespace HPHP {
+
+const StaticString
+  s_mongomatcher("MongoMatcher"),
+  s_mongo_matcher("__mongo_matcher");
+
+////////////////////////////////////////////////////////////////////////////////
+// Compiled filter
+
+enum class MatchOp { And, Or, Nor, Eq, Ne, Gt, Gte, Lt, Lte, In, Nin, Exists };
+
+struct MatchNode {
+  MatchOp op;
+  std::string path;
+
+  // Operands point into the encoded filter owned by the matcher
+  bson_iter_t operand;
+  std::vector<bson_iter_t> operands;
+  bool exists;
+
+  std::vector<MatchNode> children;
+};
+
+class MongoMatcherData : public SweepableResourceData {
+public:
+  explicit MongoMatcherData(const Array& filter);
+  ~MongoMatcherData();
+
+  CLASSNAME_IS("mongo matcher")
+
+  // overriding ResourceData
+  virtual const String& o_getClassNameHook() const { return classnameof(); }
+
+  bool compile(std::string& error);
+  bool matches(const bson_t *doc) const;
+
+private:
+  bool compileDocument(const bson_iter_t *filter, std::vector<MatchNode>& out, std::string& error);
+  bool compileOperators(const char *path, const bson_iter_t *ops, std::vector<MatchNode>& out, std::string& error);
+
+  bool evalNode(const MatchNode& node, const bson_iter_t *doc) const;
+  bool evalField(const MatchNode& node, const bson_iter_t *doc) const;
+
+  bson_t m_filter;
+  MatchNode m_root;
+};
+
+MongoMatcherData::MongoMatcherData(const Array& filter) {
+  encodeToBSON(filter, &m_filter);
+  m_root.op = MatchOp::And;
+}
+
+MongoMatcherData::~MongoMatcherData() {
+  bson_destroy(&m_filter);
+}
+
+bool MongoMatcherData::compile(std::string& error) {
+  bson_iter_t iter;
+
+  if (!bson_iter_init(&iter, &m_filter)) {
+    error = "Failed to initialize BSON iterator";
+    return false;
+  }
+  return compileDocument(&iter, m_root.children, error);
+}
+
+static bool is_operator_document(const bson_iter_t *iter) {
+  bson_iter_t child;
+
+  if (!BSON_ITER_HOLDS_DOCUMENT(iter) || !bson_iter_recurse(iter, &child)) {
+    return false;
+  }
+  return bson_iter_next(&child) && bson_iter_key(&child)[0] == '$';
+}
+
+bool MongoMatcherData::compileDocument(const bson_iter_t *filter,
+                                       std::vector<MatchNode>& out,
+                                       std::string& error) {
+  bson_iter_t iter = *filter;
+
+  while (bson_iter_next(&iter)) {
+    const char *key = bson_iter_key(&iter);
+
+    if (key[0] != '$') {
+      if (is_operator_document(&iter)) {
+        bson_iter_t ops;
+        bson_iter_recurse(&iter, &ops);
+        if (!compileOperators(key, &ops, out, error)) {
+          return false;
+        }
+      } else {
+        MatchNode node;
+        node.op = MatchOp::Eq;
+        node.path = key;
+        node.operand = iter;
+        out.push_back(std::move(node));
+      }
+      continue;
+    }
+
+    MatchNode node;
+    if (strcmp(key, "$and") == 0) {
+      node.op = MatchOp::And;
+    } else if (strcmp(key, "$or") == 0) {
+      node.op = MatchOp::Or;
+    } else if (strcmp(key, "$nor") == 0) {
+      node.op = MatchOp::Nor;
+    } else {
+      error = std::string("Unsupported query operator: ") + key;
+      return false;
+    }
+
+    bson_iter_t clauses;
+    if (!BSON_ITER_HOLDS_ARRAY(&iter) || !bson_iter_recurse(&iter, &clauses)) {
+      error = std::string(key) + " expects an array of queries";
+      return false;
+    }
+
+    // Each clause is itself an implicit $and of its fields
+    while (bson_iter_next(&clauses)) {
+      bson_iter_t clause;
+      if (!BSON_ITER_HOLDS_DOCUMENT(&clauses) || !bson_iter_recurse(&clauses, &clause)) {
+        error = std::string(key) + " expects an array of queries";
+        return false;
+      }
+
+      MatchNode child;
+      child.op = MatchOp::And;
+      if (!compileDocument(&clause, child.children, error)) {
+        return false;
+      }
+      node.children.push_back(std::move(child));
+    }
+    out.push_back(std::move(node));
+  }
+  return true;
+}
+
+bool MongoMatcherData::compileOperators(const char *path,
+                                        const bson_iter_t *ops,
+                                        std::vector<MatchNode>& out,
+                                        std::string& error) {
+  bson_iter_t iter = *ops;
+
+  while (bson_iter_next(&iter)) {
+    const char *op = bson_iter_key(&iter);
+    MatchNode node;
+    node.path = path;
+    node.operand = iter;
+
+    if (strcmp(op, "$eq") == 0) {
+      node.op = MatchOp::Eq;
+    } else if (strcmp(op, "$ne") == 0) {
+      node.op = MatchOp::Ne;
+    } else if (strcmp(op, "$gt") == 0) {
+      node.op = MatchOp::Gt;
+    } else if (strcmp(op, "$gte") == 0) {
+      node.op = MatchOp::Gte;
+    } else if (strcmp(op, "$lt") == 0) {
+      node.op = MatchOp::Lt;
+    } else if (strcmp(op, "$lte") == 0) {
+      node.op = MatchOp::Lte;
+    } else if (strcmp(op, "$exists") == 0) {
+      node.op = MatchOp::Exists;
+      node.exists = bson_iter_as_bool(&iter);
+    } else if (strcmp(op, "$in") == 0 || strcmp(op, "$nin") == 0) {
+      node.op = op[1] == 'i' ? MatchOp::In : MatchOp::Nin;
+
+      bson_iter_t values;
+      if (!BSON_ITER_HOLDS_ARRAY(&iter) || !bson_iter_recurse(&iter, &values)) {
+        error = std::string(op) + " expects an array";
+        return false;
+      }
+      while (bson_iter_next(&values)) {
+        node.operands.push_back(values);
+      }
+    } else {
+      error = std::string("Unsupported query operator: ") + op;
+      return false;
+    }
+    out.push_back(std::move(node));
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Evaluation
+
+// Calls fn for every value reachable at a dotted path until it returns true.
+// As on the server, a path that meets an array is applied both as an index
+// and to each embedded document, and a leaf array also offers its elements.
+template <typename F>
+static bool any_value_at(const bson_iter_t *container, bool is_array,
+                         const char *path, const F& fn) {
+  const char *dot = strchr(path, '.');
+  size_t len = dot ? (size_t)(dot - path) : strlen(path);
+  bson_iter_t iter = *container;
+  bson_iter_t child;
+
+  while (bson_iter_next(&iter)) {
+    const char *key = bson_iter_key(&iter);
+    if (strncmp(key, path, len) != 0 || key[len] != '\0') {
+      continue;
+    }
+
+    if (!dot) {
+      if (fn(&iter)) {
+        return true;
+      }
+      if (BSON_ITER_HOLDS_ARRAY(&iter) && bson_iter_recurse(&iter, &child)) {
+        while (bson_iter_next(&child)) {
+          if (fn(&child)) {
+            return true;
+          }
+        }
+      }
+    } else if ((BSON_ITER_HOLDS_DOCUMENT(&iter) || BSON_ITER_HOLDS_ARRAY(&iter)) &&
+               bson_iter_recurse(&iter, &child) &&
+               any_value_at(&child, BSON_ITER_HOLDS_ARRAY(&iter), dot + 1, fn)) {
+      return true;
+    }
+    break;
+  }
+
+  if (is_array) {
+    iter = *container;
+    while (bson_iter_next(&iter)) {
+      if (BSON_ITER_HOLDS_DOCUMENT(&iter) && bson_iter_recurse(&iter, &child) &&
+          any_value_at(&child, false, path, fn)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool values_equal(const bson_iter_t *a, const bson_iter_t *b) {
+  return cbson_compare_values(a, b) == 0;
+}
+
+// {field: null} also matches documents without the field
+static bool matches_value(const bson_iter_t *doc, const std::string& path,
+                          const bson_iter_t *operand) {
+  if (BSON_ITER_HOLDS_NULL(operand)) {
+    bool found = any_value_at(doc, false, path.c_str(),
+      [](const bson_iter_t *) { return true; });
+    if (!found) {
+      return true;
+    }
+  }
+  return any_value_at(doc, false, path.c_str(),
+    [operand](const bson_iter_t *value) { return values_equal(value, operand); });
+}
+
+bool MongoMatcherData::evalField(const MatchNode& node, const bson_iter_t *doc) const {
+  const bson_iter_t *operand = &node.operand;
+  int canonical = cbson_canonical_type(bson_iter_type(operand));
+
+  // Range operators only compare values within the operand's type bracket
+  auto range = [&](bool (*accept)(int)) {
+    return any_value_at(doc, false, node.path.c_str(), [&](const bson_iter_t *value) {
+      return cbson_canonical_type(bson_iter_type(value)) == canonical &&
+             accept(cbson_compare_values(value, operand));
+    });
+  };
+
+  auto in = [&]() {
+    for (auto& candidate : node.operands) {
+      if (matches_value(doc, node.path, &candidate)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  switch (node.op) {
+  case MatchOp::Eq:
+    return matches_value(doc, node.path, operand);
+  case MatchOp::Ne:
+    return !matches_value(doc, node.path, operand);
+  case MatchOp::Gt:
+    return range([](int cmp) { return cmp > 0; });
+  case MatchOp::Gte:
+    return range([](int cmp) { return cmp >= 0; });
+  case MatchOp::Lt:
+    return range([](int cmp) { return cmp < 0; });
+  case MatchOp::Lte:
+    return range([](int cmp) { return cmp <= 0; });
+  case MatchOp::In:
+    return in();
+  case MatchOp::Nin:
+    return !in();
+  case MatchOp::Exists:
+    return node.exists == any_value_at(doc, false, node.path.c_str(),
+      [](const bson_iter_t *) { return true; });
+  default:
+    return false;
+  }
+}
+
+bool MongoMatcherData::evalNode(const MatchNode& node, const bson_iter_t *doc) const {
+  switch (node.op) {
+  case MatchOp::And:
+    for (auto& child : node.children) {
+      if (!evalNode(child, doc)) {
+        return false;
+      }
+    }
+    return true;
+  case MatchOp::Or:
+    for (auto& child : node.children) {
+      if (evalNode(child, doc)) {
+        return true;
+      }
+    }
+    return false;
+  case MatchOp::Nor:
+    for (auto& child : node.children) {
+      if (evalNode(child, doc)) {
+        return false;
+      }
+    }
+    return true;
+  default:
+    return evalField(node, doc);
+  }
+}
+
+bool MongoMatcherData::matches(const bson_t *doc) const {
+  bson_iter_t iter;
+
+  if (!bson_iter_init(&iter, doc)) {
+    return false;
+  }
+  return evalNode(m_root, &iter);
+}
+
+static MongoMatcherData *get_matcher(Object obj) {
+  auto res = obj->o_realProp(s_mongo_matcher, ObjectData::RealPropUnchecked, s_mongomatcher);
+
+  if (!res || !res->isResource()) {
+    mongoThrow<MongoException>("MongoMatcher was not created by MongoMatcher::compile()");
+  }
+  return res->toResource().getTyped<MongoMatcherData>(true, false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoMatcher
+
+static Object HHVM_STATIC_METHOD(MongoMatcher, compile, const Array& filter) {
+  std::string error;
+  auto matcher = new MongoMatcherData(filter);
+  Resource res(matcher);
+
+  if (!matcher->compile(error)) {
+    mongoThrow<MongoException>(error.c_str());
+  }
+
+  Object obj = MongoMatcher::allocObject();
+  obj->o_set(s_mongo_matcher, res, s_mongomatcher);
+  return obj;
+}
+
+static bool HHVM_METHOD(MongoMatcher, matches, const String& bson) {
+  bson_t doc;
+
+  cbson_init_static_from_string(&doc, bson);
+  return get_matcher(this_)->matches(&doc);
+}
+
+static Array HHVM_METHOD(MongoMatcher, filter, const Array& documents) {
+  auto matcher = get_matcher(this_);
+  Array ret = Array::Create();
+  bson_t doc;
+
+  for (ArrayIter it(documents); it; ++it) {
+    const Variant& value = it.secondRef();
+    if (!value.isString()) {
+      mongoThrow<MongoException>("MongoMatcher::filter() expects an array of BSON strings");
+    }
+
+    cbson_init_static_from_string(&doc, value.toString());
+    if (matcher->matches(&doc)) {
+      ret.set(it.first(), value);
+    }
+  }
+  return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MongoExtension::_initMongoMatcherClass() {
+    HHVM_STATIC_ME(MongoMatcher, compile);
+    HHVM_ME(MongoMatcher, matches);
+    HHVM_ME(MongoMatcher, filter);
+}
+
+} // namespace HPHP
@@ -0,0 +1,43 @@
+<?hh
+
+/**
+ * A query filter compiled once and evaluated in process against raw BSON
+ * documents, such as cached query results or tailed documents, without
+ * decoding them.
+ */
+class MongoMatcher {
+
+  /**
+   * Compiles a query filter
+   *
+   * @param array $filter - filter    The query, in the same syntax as
+   *   MongoCollection::find(). Equality, $eq, $ne, $gt, $gte, $lt, $lte,
+   *   $in, $nin, $exists, $and, $or and $nor are supported on dotted
+   *   field paths.
+   *
+   * @return MongoMatcher - Returns the compiled matcher.
+   */
+  <<__Native>>
+  public static function compile(array $filter): MongoMatcher;
+
+  /**
+   * Checks whether a BSON document matches the filter
+   *
+   * @param string $bson - bson    The BSON document.
+   *
+   * @return bool - Returns TRUE if the document matches.
+   */
+  <<__Native>>
+  public function matches(string $bson): bool;
+
+  /**
+   * Keeps the BSON documents of a list that match the filter
+   *
+   * @param array $documents - documents    An array of BSON strings.
+   *
+   * @return array - Returns the matching documents, with their keys
+   *   preserved.
+   */
+  <<__Native>>
+  public function filter(array $documents): array;
+}
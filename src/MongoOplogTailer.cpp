@@ -0,0 +1,211 @@
+#include <string.h>
+#include <string>
+#include "ext_mongo.h"
+#include "bson_decode.h"
+#include "contrib/encode.h"
+
+namespace HPHP {
+
+const StaticString
+  s_mongooplogtailer("MongoOplogTailer"),
+  s_mongo_oplog_cursor("__mongo_oplog_cursor"),
+  s_position("position");
+
+////////////////////////////////////////////////////////////////////////////////
+// Tailable cursor on local.oplog.rs
+
+class MongoOplogCursor : public SweepableResourceData {
+public:
+  explicit MongoOplogCursor(mongoc_client_t *client)
+    : m_collection(mongoc_client_get_collection(client, "local", "oplog.rs")),
+      m_cursor(nullptr) {}
+
+  ~MongoOplogCursor() {
+    close();
+    mongoc_collection_destroy(m_collection);
+  }
+
+  CLASSNAME_IS("mongo oplog cursor")
+
+  // overriding ResourceData
+  virtual const String& o_getClassNameHook() const { return classnameof(); }
+
+  mongoc_cursor_t *get() { return m_cursor; }
+
+  // OPLOG_REPLAY lets the server seek straight to the first entry after
+  // the position instead of scanning the capped collection
+  void open(uint32_t timestamp, uint32_t increment, const Array& filter) {
+    bson_t query, ts, filter_bs;
+
+    close();
+
+    bson_init(&query);
+    bson_append_document_begin(&query, "ts", 2, &ts);
+    bson_append_timestamp(&ts, "$gt", 3, timestamp, increment);
+    bson_append_document_end(&query, &ts);
+
+    encodeToBSON(filter, &filter_bs);
+    bson_concat(&query, &filter_bs);
+    bson_destroy(&filter_bs);
+
+    m_cursor = mongoc_collection_find(m_collection,
+                                      (mongoc_query_flags_t)(MONGOC_QUERY_TAILABLE_CURSOR |
+                                                             MONGOC_QUERY_AWAIT_DATA |
+                                                             MONGOC_QUERY_OPLOG_REPLAY |
+                                                             MONGOC_QUERY_NO_CURSOR_TIMEOUT),
+                                      0, 0, 0, &query, nullptr, nullptr);
+    bson_destroy(&query);
+  }
+
+  void close() {
+    if (m_cursor != nullptr) {
+      mongoc_cursor_destroy(m_cursor);
+      m_cursor = nullptr;
+    }
+  }
+
+  // Timestamp of the newest entry, or false if the oplog is empty
+  bool latest(bson_iter_t *ts, bson_t *holder, bson_error_t *error) {
+    bson_t query, orderby, fields;
+    const bson_t *doc;
+    bool found = false;
+
+    memset(error, 0, sizeof(*error));
+    bson_init(&query);
+    bson_append_document_begin(&query, "$query", 6, &orderby);
+    bson_append_document_end(&query, &orderby);
+    bson_append_document_begin(&query, "$orderby", 8, &orderby);
+    bson_append_int32(&orderby, "$natural", 8, -1);
+    bson_append_document_end(&query, &orderby);
+
+    bson_init(&fields);
+    bson_append_int32(&fields, "ts", 2, 1);
+
+    mongoc_cursor_t *cursor = mongoc_collection_find(m_collection, MONGOC_QUERY_NONE,
+                                                     0, 1, 0, &query, &fields, nullptr);
+    if (mongoc_cursor_next(cursor, &doc)) {
+      bson_copy_to(doc, holder);
+      found = bson_iter_init_find(ts, holder, "ts") && BSON_ITER_HOLDS_TIMESTAMP(ts);
+      if (!found) {
+        bson_destroy(holder);
+      }
+    }
+    bool failed = mongoc_cursor_error(cursor, error);
+
+    mongoc_cursor_destroy(cursor);
+    bson_destroy(&fields);
+    bson_destroy(&query);
+    return !failed && found;
+  }
+
+private:
+  mongoc_collection_t *m_collection;
+  mongoc_cursor_t *m_cursor;
+};
+
+static MongoOplogCursor *get_oplog_cursor(const Object& obj) {
+  auto res = obj->o_realProp(s_mongo_oplog_cursor, ObjectData::RealPropUnchecked, s_mongooplogtailer);
+
+  if (res && res->isResource()) {
+    return res->toResource().getTyped<MongoOplogCursor>(true, false);
+  }
+
+  auto client = obj->o_realProp("client", ObjectData::RealPropUnchecked, s_mongooplogtailer)->toObject();
+  auto oplog = new MongoOplogCursor(get_client(client)->get());
+  obj->o_set(s_mongo_oplog_cursor, Resource(oplog), s_mongooplogtailer);
+  return oplog;
+}
+
+// Without a position, tailing starts after the newest entry
+static void resolve_position(const Object& this_, MongoOplogCursor *oplog,
+                             uint32_t *timestamp, uint32_t *increment) {
+  auto position = this_->o_realProp(s_position, ObjectData::RealPropUnchecked, s_mongooplogtailer);
+
+  if (position && position->isObject()) {
+    Object ts = position->toObject();
+    *timestamp = (uint32_t) ts->o_get("sec").toInt64();
+    *increment = (uint32_t) ts->o_get("inc").toInt64();
+    return;
+  }
+
+  bson_t holder;
+  bson_iter_t ts;
+  bson_error_t error;
+
+  *timestamp = 0;
+  *increment = 0;
+  if (oplog->latest(&ts, &holder, &error)) {
+    bson_iter_timestamp(&ts, timestamp, increment);
+    this_->o_set(s_position, cbson_loads_value(&ts), s_mongooplogtailer);
+    bson_destroy(&holder);
+  } else if (error.domain != 0) {
+    mongoThrowError(error);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoOplogTailer
+
+static Array HHVM_METHOD(MongoOplogTailer, poll, int64_t maxEntries) {
+  auto oplog = get_oplog_cursor(this_);
+  auto filter = this_->o_realProp("filter", ObjectData::RealPropUnchecked, s_mongooplogtailer)->toArray();
+  Array ret = Array::Create();
+  Variant last_ts;
+  bool reopened = false;
+  bson_error_t error;
+
+  while (ret.size() < maxEntries) {
+    if (!oplog->get()) {
+      uint32_t timestamp, increment;
+      resolve_position(this_, oplog, &timestamp, &increment);
+      oplog->open(timestamp, increment, filter);
+    }
+
+    const bson_t *doc;
+    if (mongoc_cursor_next(oplog->get(), &doc)) {
+      bson_iter_t ts;
+      if (bson_iter_init_find(&ts, doc, "ts")) {
+        last_ts = cbson_loads_value(&ts);
+      }
+      ret.append(cbson_loads(doc));
+      continue;
+    }
+
+    if (mongoc_cursor_error(oplog->get(), &error)) {
+      // Resume from the last delivered entry with a fresh cursor; entries
+      // already read in this poll are returned first
+      oplog->close();
+      if (ret.empty() && !reopened) {
+        reopened = true;
+        continue;
+      }
+      if (ret.empty()) {
+        mongoThrowError(error);
+      }
+    } else if (!mongoc_cursor_more(oplog->get())) {
+      // The server killed the cursor, e.g. after a rollover of the capped
+      // collection; the next poll reopens it
+      oplog->close();
+    }
+    break;
+  }
+
+  if (!last_ts.isNull()) {
+    this_->o_set(s_position, last_ts, s_mongooplogtailer);
+  }
+  return ret;
+}
+
+static void HHVM_METHOD(MongoOplogTailer, seek, const Object& position) {
+  this_->o_set(s_position, position, s_mongooplogtailer);
+  get_oplog_cursor(this_)->close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MongoExtension::_initMongoOplogTailerClass() {
+  HHVM_ME(MongoOplogTailer, poll);
+  HHVM_ME(MongoOplogTailer, seek);
+}
+
+} // namespace HPHP
@@ -0,0 +1,106 @@
+<?hh
+
+/**
+ * Consumes the replica set oplog (local.oplog.rs) from a resumable position.
+ *
+ * Entries are read through a tailable, await-data cursor that is opened with
+ * an indexed "ts > position" query and reopened from the last delivered
+ * position after network errors or when the server kills it.
+ */
+class MongoOplogTailer {
+  private $client;
+  private $position = null;
+  private $filter = [];
+
+  /**
+   * Creates a new oplog tailer
+   *
+   * @param MongoClient $client - client    A client connected to a replica
+   *   set member.
+   * @param MongoTimestamp $since - since    Position to resume from, as
+   *   returned by getPosition(). Entries with a later ts are delivered. If
+   *   NULL, tailing starts after the newest entry in the oplog.
+   * @param array $filter - filter    Additional conditions on the entries,
+   *   e.g. array("ns" => "app.users"). It must not constrain "ts".
+   *
+   * @return - Returns a new oplog tailer.
+   */
+  public function __construct(MongoClient $client,
+                              ?MongoTimestamp $since = null,
+                              array $filter = array()) {
+    $this->client = $client;
+    $this->position = $since;
+    $this->filter = $filter;
+  }
+
+  /**
+   * Fetches the next entries of the oplog
+   *
+   * Blocks for at most the server's await-data timeout when no entries are
+   * available.
+   *
+   * @param int $maxEntries - maxEntries    The maximum number of entries
+   *   to return.
+   *
+   * @return array - Returns the entries, oldest first. The position is
+   *   advanced past the last one.
+   */
+  <<__Native>>
+  public function poll(int $maxEntries = 100): array;
+
+  /**
+   * Delivers entries to a callback in batches until it returns FALSE
+   *
+   * @param callable $callback - callback    Called with each non-empty
+   *   batch of entries. Once the batch is processed, getPosition() is the
+   *   checkpoint to persist for resuming.
+   * @param int $maxEntries - maxEntries    The maximum batch size.
+   *
+   * @return void
+   */
+  public function tail(callable $callback, int $maxEntries = 100): void {
+    while (true) {
+      $entries = $this->poll($maxEntries);
+      if ($entries && $callback($entries) === false) {
+        return;
+      }
+    }
+  }
+
+  /**
+   * Yields oplog entries as they arrive
+   *
+   * @param int $maxEntries - maxEntries    How many entries to fetch at
+   *   a time.
+   *
+   * @return Generator - Yields entries forever.
+   */
+  public function entries(int $maxEntries = 100): Generator {
+    while (true) {
+      foreach ($this->poll($maxEntries) as $entry) {
+        yield $entry;
+      }
+    }
+  }
+
+  /**
+   * Returns the timestamp of the last delivered entry
+   *
+   * @return MongoTimestamp - Returns the position, or NULL if nothing has
+   *   been polled yet and no starting position was given.
+   */
+  public function getPosition(): ?MongoTimestamp {
+    return $this->position;
+  }
+
+  /**
+   * Moves the tailer to a new position
+   *
+   * @param MongoTimestamp $position - position    The following poll()
+   *   delivers entries with a later ts.
+   *
+   * @return void
+   */
+  <<__Native>>
+  public function seek(MongoTimestamp $position): void;
+}
@@ -0,0 +1,205 @@
+<?hh
+
+/**
+ * Consumes a capped collection used as a queue.
+ *
+ * Messages are read in insertion order through a tailable, await-data
+ * cursor that prefetches a window of messages. Acknowledged progress is
+ * kept in memory and written to a progress collection as one upsert per
+ * flush interval. That record lets a restarted consumer resume after the
+ * last acknowledged message.
+ */
+class MongoQueueConsumer {
+  private $queue;
+  private $name;
+  private $progress;
+  private $cursor = null;
+  private $prefetch = 100;
+  private $flushInterval = 1000;
+  private $lastId = null;
+  private $ackedId = null;
+  private $pendingAcks = 0;
+  private $lastFlush = 0.0;
+  private $stats = [
+    "fetches" => 0,
+    "received" => 0,
+    "acked" => 0,
+    "batches" => 0,
+    "flushes" => 0,
+    "reconnects" => 0,
+    "fetch_time_ms" => 0.0,
+    "max_fetch_ms" => 0.0,
+  ];
+  private $started = 0.0;
+
+  /**
+   * Creates a new queue consumer
+   *
+   * @param MongoCollection $queue - queue    The capped collection to
+   *   consume. Messages need increasing _id values, such as MongoIds.
+   * @param string $name - name    Identifies the consumer's progress
+   *   record.
+   * @param array $options - options    "prefetch" (number of messages the
+   *   server sends per batch, default 100), "flushInterval" (milliseconds
+   *   between progress writes, default 1000) and "progress" (the
+   *   MongoCollection storing progress, default "<queue>.consumers" in the
+   *   same database).
+   *
+   * @return - Returns a new queue consumer.
+   */
+  public function __construct(MongoCollection $queue,
+                              string $name,
+                              array $options = array()) {
+    $this->queue = $queue;
+    $this->name = $name;
+    if (isset($options["prefetch"])) {
+      $this->prefetch = max(1, (int) $options["prefetch"]);
+    }
+    if (isset($options["flushInterval"])) {
+      $this->flushInterval = (int) $options["flushInterval"];
+    }
+    $this->progress = isset($options["progress"])
+      ? $options["progress"]
+      : $queue->__get("consumers");
+
+    $record = $this->progress->findOne(array("_id" => $name));
+    if ($record && isset($record["last"])) {
+      $this->lastId = $this->ackedId = $record["last"];
+    }
+    $this->started = $this->lastFlush = microtime(true);
+  }
+
+  /**
+   * Fetches the next messages
+   *
+   * @param int $max - max    The maximum number of messages to return.
+   *   Defaults to the prefetch window.
+   *
+   * @return array - Returns the messages in insertion order. The array is
+   *   empty if none arrived within the server's await period.
+   */
+  public function fetch(int $max = 0): array {
+    $start = microtime(true);
+    $messages = array();
+
+    try {
+      if (!$this->cursor) {
+        $query = $this->lastId === null ? array() : array("_id" => array('$gt' => $this->lastId));
+        $this->cursor = $this->queue->find($query)
+          ->tailable()
+          ->awaitData()
+          ->batchSize($this->prefetch);
+      }
+      $messages = $this->cursor->fetchBatch($max > 0 ? $max : $this->prefetch);
+      // A dead cursor (e.g. on an empty queue) is reopened on the next call
+      if (!$messages && !$this->cursor->hasNext()) {
+        $this->cursor = null;
+      }
+    } catch (MongoCursorException $e) {
+      $this->cursor = null;
+      $this->stats["reconnects"]++;
+    } catch (MongoConnectionException $e) {
+      // Network and server selection errors; the cursor is reopened on
+      // the next call
+      $this->cursor = null;
+      $this->stats["reconnects"]++;
+    }
+
+    if ($messages) {
+      $this->lastId = $messages[count($messages) - 1]["_id"];
+      $this->stats["received"] += count($messages);
+      $this->stats["batches"]++;
+    }
+
+    $elapsed = (microtime(true) - $start) * 1000;
+    $this->stats["fetches"]++;
+    $this->stats["fetch_time_ms"] += $elapsed;
+    $this->stats["max_fetch_ms"] = max($this->stats["max_fetch_ms"], $elapsed);
+
+    $this->maybeFlush();
+    return $messages;
+  }
+
+  /**
+   * Acknowledges messages up to and including the given one
+   *
+   * @param array $message - message    The last processed message, as
+   *   returned by fetch().
+   *
+   * @return void
+   */
+  public function ack(array $message): void {
+    $this->ackedId = $message["_id"];
+    $this->pendingAcks++;
+    $this->stats["acked"]++;
+    $this->maybeFlush();
+  }
+
+  /**
+   * Acknowledges a batch of messages returned by fetch()
+   *
+   * @param array $messages - messages    The processed messages.
+   *
+   * @return void
+   */
+  public function ackAll(array $messages): void {
+    if ($messages) {
+      $this->ackedId = $messages[count($messages) - 1]["_id"];
+      $this->pendingAcks += count($messages);
+      $this->stats["acked"] += count($messages);
+      $this->maybeFlush();
+    }
+  }
+
+  /**
+   * Writes the acknowledged position to the progress collection now
+   *
+   * @return bool - Returns TRUE if there was progress to write.
+   */
+  public function flush(): bool {
+    $this->lastFlush = microtime(true);
+    if (!$this->pendingAcks) {
+      return false;
+    }
+
+    $this->progress->update(
+      array("_id" => $this->name),
+      array('$set' => array("last" => $this->ackedId, "updated" => new MongoDate()),
+            '$inc' => array("acked" => $this->pendingAcks)),
+      array("upsert" => true));
+    $this->pendingAcks = 0;
+    $this->stats["flushes"]++;
+    return true;
+  }
+
+  /**
+   * Returns throughput and latency counters
+   *
+   * @return array - Returns "fetches", "received", "acked",
+   *   "pending_acks", "batches", "flushes", "reconnects", "messages_per_sec",
+   *   "avg_fetch_ms" and "max_fetch_ms".
+   */
+  public function getStats(): array {
+    $stats = $this->stats;
+    $elapsed = microtime(true) - $this->started;
+
+    $stats["pending_acks"] = $this->pendingAcks;
+    $stats["messages_per_sec"] = $elapsed > 0 ? $stats["received"] / $elapsed : 0.0;
+    $stats["avg_fetch_ms"] = $stats["fetches"] ? $stats["fetch_time_ms"] / $stats["fetches"] : 0.0;
+    unset($stats["fetch_time_ms"]);
+    return $stats;
+  }
+
+  public function __destruct() {
+    if ($this->pendingAcks) {
+      $this->flush();
+    }
+  }
+
+  private function maybeFlush(): void {
+    if ($this->pendingAcks &&
+        (microtime(true) - $this->lastFlush) * 1000 >= $this->flushInterval) {
+      $this->flush();
+    }
+  }
+}
@@ -0,0 +1,147 @@
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ext_mongo.h"
+#include "bson_compare.h"
+#include "bson_decode.h"
+#include "contrib/encode.h"
+
+namespace HPHP {
+
+const StaticString
+  s_mongoshardedclient("MongoShardedClient");
+
+////////////////////////////////////////////////////////////////////////////////
+// Scatter-gather
+
+// Results of one deployment. Worker threads only touch libmongoc and
+// libbson; everything involving the HHVM heap stays on the request thread.
+struct ShardResult {
+  mongoc_client_t *client;
+  std::vector<bson_t *> docs;
+  bool failed = false;
+  bson_error_t error;
+
+  ~ShardResult() {
+    for (auto doc : docs) {
+      bson_destroy(doc);
+    }
+  }
+};
+
+static void shard_find(ShardResult *shard, const char *db, const char *collection_name,
+                       const bson_t *query, const bson_t *fields, uint32_t limit) {
+  mongoc_collection_t *collection = mongoc_client_get_collection(shard->client, db, collection_name);
+  mongoc_cursor_t *cursor = mongoc_collection_find(collection, MONGOC_QUERY_NONE, 0, limit, 0,
+                                                   query, fields, nullptr);
+  const bson_t *doc;
+
+  while (mongoc_cursor_next(cursor, &doc)) {
+    shard->docs.push_back(bson_copy(doc));
+  }
+  shard->failed = mongoc_cursor_error(cursor, &shard->error);
+
+  mongoc_cursor_destroy(cursor);
+  mongoc_collection_destroy(collection);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoShardedClient
+
+static Array HHVM_METHOD(MongoShardedClient, scatterFind, const String& db, const String& collection,
+                         const Array& query, const Array& fields, const Array& sort, int64_t limit) {
+  auto clients = this_->o_realProp("clients", ObjectData::RealPropUnchecked, s_mongoshardedclient)->toArray();
+  std::vector<ShardResult> shards(clients.size());
+  bson_t query_bs, fields_bs;
+
+  // Each worker drives a different deployment's persistent client, and the
+  // request thread that owns those clients waits for all of them
+  size_t i = 0;
+  for (ArrayIter it(clients); it; ++it, ++i) {
+    shards[i].client = get_client(it.second().toObject())->get();
+  }
+
+  if (sort.empty()) {
+    encodeToBSON(query, &query_bs);
+  } else {
+    Array wrapped = Array::Create();
+    wrapped.set(String("$query"), query.empty() ? Variant(Array::Create()) : Variant(query));
+    wrapped.set(String("$orderby"), sort);
+    encodeToBSON(wrapped, &query_bs);
+  }
+  encodeToBSON(fields, &fields_bs);
+
+  std::vector<std::thread> workers;
+  for (auto& shard : shards) {
+    workers.emplace_back(shard_find, &shard, db.c_str(), collection.c_str(),
+                         &query_bs, &fields_bs, (uint32_t) limit);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  bson_destroy(&query_bs);
+  bson_destroy(&fields_bs);
+
+  for (auto& shard : shards) {
+    if (shard.failed) {
+      mongoThrowError(shard.error);
+    }
+  }
+
+  Array ret = Array::Create();
+
+  if (sort.empty()) {
+    for (auto& shard : shards) {
+      for (auto doc : shard.docs) {
+        if (limit > 0 && ret.size() >= limit) {
+          return ret;
+        }
+        ret.append(cbson_loads(doc));
+      }
+    }
+    return ret;
+  }
+
+  // k-way merge of the sorted per-deployment results; a heap entry is a
+  // deployment and the position of its next document
+  cbson_sort_spec spec;
+  cbson_sort_spec_from_array(sort, &spec);
+  size_t width = spec.paths.size();
+  std::vector<size_t> positions(shards.size(), 0);
+  std::vector<bson_iter_t> keys(shards.size() * width);
+
+  auto compare = [&](size_t a, size_t b) {
+    int cmp = cbson_compare_sort_keys(keys.data() + a * width, keys.data() + b * width, spec);
+    // Ties keep deployment order
+    return cmp != 0 ? cmp > 0 : a > b;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(compare)> heap(compare);
+
+  for (size_t s = 0; s < shards.size(); s++) {
+    if (!shards[s].docs.empty()) {
+      cbson_sort_keys(shards[s].docs[0], spec, keys.data() + s * width);
+      heap.push(s);
+    }
+  }
+
+  while (!heap.empty() && (limit <= 0 || ret.size() < limit)) {
+    size_t s = heap.top();
+    heap.pop();
+    ret.append(cbson_loads(shards[s].docs[positions[s]]));
+
+    if (++positions[s] < shards[s].docs.size()) {
+      cbson_sort_keys(shards[s].docs[positions[s]], spec, keys.data() + s * width);
+      heap.push(s);
+    }
+  }
+  return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MongoExtension::_initMongoShardedClientClass() {
+  HHVM_ME(MongoShardedClient, scatterFind);
+}
+
+} // namespace HPHP
@@ -0,0 +1,257 @@
+<?hh
+
+/**
+ * Routes one logical collection across several independent deployments.
+ *
+ * Documents are placed by consistent hashing of a shard key, so adding a
+ * deployment only moves the keys of its neighbours on the hash ring.
+ * Queries that include the shard key go to one deployment. Other queries
+ * are sent to all of them concurrently, and the sorted results are merged
+ * in native code.
+ */
+class MongoShardedClient {
+  const VIRTUAL_NODES = 128;
+
+  private $uris = [];
+  private $clients = [];
+  private $shardKey;
+  private $ring = [];
+  private $ringShards = [];
+
+  /**
+   * Creates a new sharded client
+   *
+   * @param array $uris - uris    Connection strings of the deployments,
+   *   each one distinct. Clients are the persistent ones MongoClient
+   *   keeps per connection string.
+   * @param string|Closure $shardKey - shardKey    The field holding the
+   *   shard key, or a Closure or invokable object that returns the key of
+   *   a document or query, or NULL if it has none. Strings are always
+   *   field names, even when they name a function.
+   *
+   * @return - Returns a new sharded client.
+   */
+  public function __construct(array $uris, mixed $shardKey) {
+    if (!$uris || count(array_unique($uris)) != count($uris)) {
+      throw new MongoException("MongoShardedClient needs distinct connection strings");
+    }
+    if (!is_string($shardKey) && !(is_object($shardKey) && is_callable($shardKey))) {
+      throw new MongoException("The shard key must be a field name or a Closure");
+    }
+
+    $this->uris = array_values($uris);
+    $this->shardKey = $shardKey;
+    $points = array();
+    foreach ($this->uris as $shard => $uri) {
+      $this->clients[$shard] = new MongoClient($uri);
+      for ($i = 0; $i < self::VIRTUAL_NODES; $i++) {
+        $points[crc32($uri . "#" . $i)] = $shard;
+      }
+    }
+    ksort($points);
+    $this->ring = array_keys($points);
+    $this->ringShards = array_values($points);
+  }
+
+  /**
+   * Gets a sharded collection
+   *
+   * @param string $db - db    The database name.
+   * @param string $name - name    The collection name.
+   *
+   * @return MongoShardedCollection - Returns the collection.
+   */
+  public function selectCollection(string $db,
+                                   string $name): MongoShardedCollection {
+    return new MongoShardedCollection($this, $db, $name);
+  }
+
+  /**
+   * Returns the clients of the deployments
+   *
+   * @return array - Returns the MongoClients, in the order of the
+   *   connection strings.
+   */
+  public function getClients(): array {
+    return $this->clients;
+  }
+
+  /**
+   * Extracts the shard key of a document or query
+   *
+   * @param array $document - document    A document or query.
+   *
+   * @return mixed - Returns the key, or NULL if there is none or the
+   *   query does not pin it to a single value.
+   */
+  public function extractKey(array $document): mixed {
+    if (is_object($this->shardKey)) {
+      $callback = $this->shardKey;
+      return $callback($document);
+    }
+    if (!array_key_exists($this->shardKey, $document)) {
+      return null;
+    }
+    $key = $document[$this->shardKey];
+    // Operator expressions such as $in may span several deployments
+    if (is_array($key) && $key && is_string(key($key)) && key($key)[0] == '$') {
+      return null;
+    }
+    return $key;
+  }
+
+  /**
+   * Returns the deployment owning a shard key
+   *
+   * @param mixed $key - key    The shard key.
+   *
+   * @return int - Returns the index of the deployment.
+   */
+  public function shardFor(mixed $key): int {
+    $hash = crc32(is_scalar($key) ? (string) $key : bson_encode(array("k" => $key)));
+
+    // First ring point at or after the hash, wrapping around
+    $low = 0;
+    $high = count($this->ring);
+    while ($low < $high) {
+      $mid = ($low + $high) >> 1;
+      if ($this->ring[$mid] < $hash) {
+        $low = $mid + 1;
+      } else {
+        $high = $mid;
+      }
+    }
+    return $this->ringShards[$low == count($this->ring) ? 0 : $low];
+  }
+
+  /**
+   * Runs a query on every deployment concurrently
+   *
+   * @param string $db - db    The database name.
+   * @param string $collection - collection    The collection name.
+   * @param array $query - query    The query.
+   * @param array $fields - fields    Fields of the results to return.
+   * @param array $sort - sort    The sort order, as for
+   *   MongoCursor::sort(). Each deployment sorts its results and they are
+   *   merged in this order; without it, results are concatenated in
+   *   deployment order.
+   * @param int $limit - limit    The maximum number of results, or 0 for
+   *   all of them.
+   *
+   * @return array - Returns the results.
+   */
+  <<__Native>>
+  public function scatterFind(string $db,
+                              string $collection,
+                              array $query,
+                              array $fields = array(),
+                              array $sort = array(),
+                              int $limit = 0): array;
+}
+
+/**
+ * A collection split across the deployments of a MongoShardedClient.
+ */
+class MongoShardedCollection {
+  private $client;
+  private $db;
+  private $name;
+
+  public function __construct(MongoShardedClient $client,
+                              string $db,
+                              string $name) {
+    $this->client = $client;
+    $this->db = $db;
+    $this->name = $name;
+  }
+
+  /**
+   * Inserts a document into the deployment owning its shard key
+   *
+   * @param array $a - a    The document. It must contain the shard key.
+   * @param array $options - options    Options for the insert.
+   *
+   * @return mixed - As MongoCollection::insert().
+   */
+  public function insert(array &$a, array $options = array()): mixed {
+    $key = $this->client->extractKey($a);
+    if ($key === null) {
+      throw new MongoException("Document has no shard key");
+    }
+    return $this->shard($key)->insert($a, $options);
+  }
+
+  /**
+   * Updates documents
+   *
+   * @param array $criteria - criteria    The query. Without the shard
+   *   key, the update is sent to every deployment.
+   * @param array $new_object - new_object    The update.
+   * @param array $options - options    Options for the update.
+   *
+   * @return mixed - Returns the result from the deployment, or TRUE if
+   *   the update was sent to all of them.
+   */
+  public function update(array $criteria,
+                         array $new_object,
+                         array $options = array()): mixed {
+    $key = $this->client->extractKey($criteria);
+    if ($key !== null) {
+      return $this->shard($key)->update($criteria, $new_object, $options);
+    }
+    foreach ($this->client->getClients() as $client) {
+      $client->selectCollection($this->db, $this->name)->update($criteria, $new_object, $options);
+    }
+    return true;
+  }
+
+  /**
+   * Queries the collection
+   *
+   * @param array $query - query    The query. With the shard key, it is
+   *   sent to one deployment; otherwise to all of them concurrently.
+   * @param array $fields - fields    Fields of the results to return.
+   * @param array $sort - sort    The sort order.
+   * @param int $limit - limit    The maximum number of results, or 0.
+   *
+   * @return array - Returns the results.
+   */
+  public function find(array $query = array(),
+                       array $fields = array(),
+                       array $sort = array(),
+                       int $limit = 0): array {
+    $key = $this->client->extractKey($query);
+    if ($key === null) {
+      return $this->client->scatterFind($this->db, $this->name, $query, $fields, $sort, $limit);
+    }
+
+    $cursor = $this->shard($key)->find($query, $fields)->limit($limit);
+    if ($sort) {
+      $cursor->sort($sort);
+    }
+    return array_values(iterator_to_array($cursor));
+  }
+
+  /**
+   * Queries the collection, returning a single document
+   *
+   * @param array $query - query    The query.
+   * @param array $fields - fields    Fields of the result to return.
+   *
+   * @return array - Returns the document, or NULL.
+   */
+  public function findOne(array $query = array(),
+                          array $fields = array()): ?array {
+    $key = $this->client->extractKey($query);
+    if ($key !== null) {
+      return $this->shard($key)->findOne($query, $fields);
+    }
+    $results = $this->client->scatterFind($this->db, $this->name, $query, $fields, array(), 1);
+    return $results ? $results[0] : null;
+  }
+
+  private function shard(mixed $key): MongoCollection {
+    $clients = $this->client->getClients();
+    return $clients[$this->client->shardFor($key)]->selectCollection($this->db, $this->name);
+  }
+}
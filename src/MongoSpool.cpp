@@ -0,0 +1,71 @@
+#include <algorithm>
+#include "ext_mongo.h"
+#include "mongo_spool.h"
+
+namespace HPHP {
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoSpool
+
+static void HHVM_STATIC_METHOD(MongoSpool, configure, const Array& options) {
+  MongoSpoolOptions spool_options = mongo_spool_options();
+
+  if (options.exists(String("dir"))) {
+    spool_options.dir = options[String("dir")].toString().toCppString();
+  }
+  if (options.exists(String("segmentSize"))) {
+    spool_options.segment_bytes = options[String("segmentSize")].toInt64();
+    if (spool_options.segment_bytes < 16 * 1024 * 1024) {
+      mongoThrow<MongoException>("The spool segment size must be at least the maximum BSON document size (16 MB)");
+    }
+  }
+  if (options.exists(String("replayInterval"))) {
+    spool_options.replay_interval_ms = options[String("replayInterval")].toInt64();
+  }
+  if (options.exists(String("batchSize"))) {
+    spool_options.batch_docs = std::max<int64_t>(1, options[String("batchSize")].toInt64());
+  }
+  mongo_spool_configure(spool_options);
+}
+
+static void HHVM_STATIC_METHOD(MongoSpool, enable, const Object& collection) {
+  auto db = collection->o_realProp("db", ObjectData::RealPropUnchecked, "MongoCollection")->toObject();
+  auto client = db->o_realProp("client", ObjectData::RealPropUnchecked, "MongoDB")->toObject();
+  String db_name = db->o_realProp("db_name", ObjectData::RealPropUnchecked, "MongoDB")->toString();
+  String collection_name = collection->o_realProp("name", ObjectData::RealPropUnchecked, "MongoCollection")->toString();
+
+  mongo_spool_enable(get_client(client)->uri(),
+                     db_name.toCppString() + "." + collection_name.toCppString());
+}
+
+static int64_t HHVM_STATIC_METHOD(MongoSpool, replay) {
+  return mongo_spool_replay();
+}
+
+static Array HHVM_STATIC_METHOD(MongoSpool, getStats) {
+  Array ret = Array::Create();
+
+  for (auto& stats : mongo_spool_stats()) {
+    Array entry = Array::Create();
+    entry.set(String("uri"), String(stats.uri));
+    entry.set(String("ns"), String(stats.ns));
+    entry.set(String("spooled"), stats.spooled);
+    entry.set(String("replayed"), stats.replayed);
+    entry.set(String("pending_bytes"), stats.pending_bytes);
+    entry.set(String("segments"), stats.segments);
+    entry.set(String("last_error"), String(stats.last_error));
+    ret.append(entry);
+  }
+  return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MongoExtension::_initMongoSpoolClass() {
+  HHVM_STATIC_ME(MongoSpool, configure);
+  HHVM_STATIC_ME(MongoSpool, enable);
+  HHVM_STATIC_ME(MongoSpool, replay);
+  HHVM_STATIC_ME(MongoSpool, getStats);
+}
+
+} // namespace HPHP
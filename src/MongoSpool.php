@@ -0,0 +1,61 @@
+<?hh
+
+/**
+ * Durable local spool for inserts during primary unavailability.
+ *
+ * For a designated namespace, MongoCollection::insert() appends the
+ * document to a local memory-mapped segment file when no primary can be
+ * reached, and returns TRUE instead of throwing. Errors returned by the
+ * server, such as duplicate keys, are thrown as usual. How long the insert may take
+ * before failing is set by the connection string, e.g.
+ * serverSelectionTimeoutMS and connectTimeoutMS. While spooled documents
+ * are pending, new inserts go straight to the spool so that order is
+ * preserved. A background thread replays the spool as ordered bulk inserts
+ * once a primary accepts writes. It checkpoints its position after every
+ * batch, and a restarted process picks up where it stopped.
+ */
+class MongoSpool {
+
+  /**
+   * Sets the spool options
+   *
+   * @param array $options - options    "dir" (directory of the spools,
+   *   default "/tmp/mongo-spool"), "segmentSize" (bytes per segment file,
+   *   default 64 MB), "replayInterval" (milliseconds between replay
+   *   attempts, default 1000) and "batchSize" (documents per bulk insert,
+   *   default 1000). Set them before enabling any namespace.
+   *
+   * @return void
+   */
+  <<__Native>>
+  public static function configure(array $options): void;
+
+  /**
+   * Designates a collection for spooling
+   *
+   * @param MongoCollection $collection - collection    The collection.
+   *   Documents left in its spool by an earlier process are replayed.
+   *
+   * @return void
+   */
+  <<__Native>>
+  public static function enable(MongoCollection $collection): void;
+
+  /**
+   * Replays every spool now
+   *
+   * @return int - Returns the number of documents written.
+   */
+  <<__Native>>
+  public static function replay(): int;
+
+  /**
+   * Returns the counters of every spool
+   *
+   * @return array - Returns one entry per spooled namespace with "uri",
+   *   "ns", "spooled", "replayed", "pending_bytes", "segments" and
+   *   "last_error".
+   */
+  <<__Native>>
+  public static function getStats(): array;
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include "ext_mongo.h"
+#include "mongo_write_queue.h"
+
+namespace HPHP {
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoWriteQueue
+
+static void HHVM_STATIC_METHOD(MongoWriteQueue, configure, const Array& options) {
+  MongoWriteQueueOptions queue_options = mongo_write_queue_options();
+
+  if (options.exists(String("capacity"))) {
+    queue_options.capacity = options[String("capacity")].toInt64();
+  }
+  if (options.exists(String("policy"))) {
+    String policy = options[String("policy")].toString();
+    if (policy == "drop") {
+      queue_options.policy = MongoWriteQueuePolicy::Drop;
+    } else if (policy == "block") {
+      queue_options.policy = MongoWriteQueuePolicy::Block;
+    } else if (policy == "spill") {
+      queue_options.policy = MongoWriteQueuePolicy::Spill;
+    } else {
+      mongoThrow<MongoException>(("Unknown write queue policy: " + policy).c_str());
+    }
+  }
+  if (options.exists(String("blockTimeout"))) {
+    queue_options.block_timeout_ms = options[String("blockTimeout")].toInt64();
+  }
+  if (options.exists(String("spillDir"))) {
+    queue_options.spill_dir = options[String("spillDir")].toString().toCppString();
+  }
+  if (options.exists(String("batchSize"))) {
+    queue_options.batch_docs = std::max<int64_t>(1, options[String("batchSize")].toInt64());
+  }
+  if (options.exists(String("w"))) {
+    queue_options.w = options[String("w")].toInt32();
+  }
+  mongo_write_queue_configure(queue_options);
+}
+
+static Array HHVM_STATIC_METHOD(MongoWriteQueue, getStats) {
+  Array ret = Array::Create();
+
+  for (auto& stats : mongo_write_queue_stats()) {
+    Array entry = Array::Create();
+    entry.set(String("uri"), String(stats.uri));
+    entry.set(String("ns"), String(stats.ns));
+    entry.set(String("depth"), stats.depth);
+    entry.set(String("enqueued"), stats.enqueued);
+    entry.set(String("written"), stats.written);
+    entry.set(String("dropped"), stats.dropped);
+    entry.set(String("spilled"), stats.spilled);
+    entry.set(String("failed"), stats.failed);
+    ret.append(entry);
+  }
+  return ret;
+}
+
+static bool HHVM_STATIC_METHOD(MongoWriteQueue, drain, int64_t timeout) {
+  return mongo_write_queue_drain(timeout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MongoExtension::_initMongoWriteQueueClass() {
+  HHVM_STATIC_ME(MongoWriteQueue, configure);
+  HHVM_STATIC_ME(MongoWriteQueue, getStats);
+  HHVM_STATIC_ME(MongoWriteQueue, drain);
+}
+
+} // namespace HPHP
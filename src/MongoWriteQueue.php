@@ -0,0 +1,53 @@
+<?hh
+
+/**
+ * Controls the process-wide queues behind MongoCollection::insertAsync().
+ *
+ * Each (connection string, namespace) pair has a bounded lock-free ring
+ * that request threads push into and a driver thread drains into unordered
+ * bulk inserts over pooled connections. Queued writes are not acknowledged
+ * to the request and are lost if the process crashes.
+ */
+class MongoWriteQueue {
+
+  /**
+   * Sets the queue options
+   *
+   * @param array $options - options    "capacity" (documents per queue,
+   *   default 16384; applies to queues created afterwards), "policy"
+   *   (what a producer does when its queue is full: "drop", "block" or
+   *   "spill"; default "drop"), "blockTimeout" (milliseconds a blocked
+   *   producer waits before dropping, default 100), "spillDir" (directory
+   *   of the overflow files, default "/tmp"), "batchSize" (documents per
+   *   bulk insert, default 1000) and "w" (write concern of the inserts).
+   *   Spilled documents, and with "spill" also batches that failed to
+   *   insert, are appended as BSON to
+   *   <spillDir>/mongo-spill-<namespace>-<pid>.bson, which
+   *   MongoCollection::restoreFrom() can replay.
+   *
+   * @return void
+   */
+  <<__Native>>
+  public static function configure(array $options): void;
+
+  /**
+   * Returns the counters of every queue
+   *
+   * @return array - Returns one entry per queue with "uri", "ns",
+   *   "depth", "enqueued", "written", "dropped", "spilled" and "failed".
+   */
+  <<__Native>>
+  public static function getStats(): array;
+
+  /**
+   * Waits until every queued document has been written
+   *
+   * @param int $timeout - timeout    The maximum time to wait, in
+   *   milliseconds.
+   *
+   * @return bool - Returns TRUE if the queues are empty, FALSE on
+   *   timeout.
+   */
+  <<__Native>>
+  public static function drain(int $timeout = 1000): bool;
+}
@@ -1,6 +1,8 @@
+#include "bson_compare.h"
 #include "bson_decode.h"
 #include "contrib/encode.h"
 #include "ext_mongo.h"
+#include <algorithm>
 #include <iostream>
 namespace HPHP {
 
@@ -13,16 +15,107 @@ namespace HPHP {
     return s;
   }
 
-    static Array HHVM_FUNCTION(bson_decode, const String& bson) {
-        return cbson_loads_from_string(bson);
+    static Variant HHVM_FUNCTION(bson_decode, const String& bson, const Array& options) {
+        if (options.empty()) {
+            return cbson_loads_from_string(bson);
+        }
+
+        cbson_loads_options decode_options;
+        cbson_loads_options_from_array(options, &decode_options);
+        return cbson_loads_from_string(bson, &decode_options);
     }
 
     static String HHVM_FUNCTION(bson_encode, const Variant& value) {
         return encode(value);
     }
 
+    // Positions iter on the element at a dotted path by walking length
+    // prefixes; nothing else in the document is decoded
+    static bool find_path(const String& bson, const String& path, bson_iter_t *iter) {
+        bson_t doc;
+        bson_iter_t root;
+
+        cbson_init_static_from_string(&doc, bson);
+        return bson_iter_init(&root, &doc) &&
+               bson_iter_find_descendant(&root, path.c_str(), iter);
+    }
+
+    static Variant HHVM_FUNCTION(bson_get, const String& bson, const String& path, const Variant& default_value) {
+        bson_iter_t iter;
+
+        if (!find_path(bson, path, &iter)) {
+            return default_value;
+        }
+        return cbson_loads_value(&iter);
+    }
+
+    static bool HHVM_FUNCTION(bson_has, const String& bson, const String& path) {
+        bson_iter_t iter;
+
+        return find_path(bson, path, &iter);
+    }
+
+    static int64_t HHVM_FUNCTION(bson_compare, const String& a, const String& b, const Array& sort) {
+        cbson_sort_spec spec;
+        bson_t a_doc, b_doc;
+
+        cbson_sort_spec_from_array(sort, &spec);
+        cbson_init_static_from_string(&a_doc, a);
+        cbson_init_static_from_string(&b_doc, b);
+
+        std::vector<bson_iter_t> keys(spec.paths.size() * 2);
+        cbson_sort_keys(&a_doc, spec, keys.data());
+        cbson_sort_keys(&b_doc, spec, keys.data() + spec.paths.size());
+
+        return cbson_compare_sort_keys(keys.data(), keys.data() + spec.paths.size(), spec);
+    }
+
+    static Array HHVM_FUNCTION(bson_sort, const Array& docs, const Array& sort) {
+        cbson_sort_spec spec;
+        bson_t doc;
+
+        cbson_sort_spec_from_array(sort, &spec);
+        size_t width = spec.paths.size();
+
+        // Keys are extracted once per document into one contiguous array,
+        // and only the document indexes move while sorting
+        std::vector<Variant> values;
+        std::vector<bson_iter_t> keys;
+        values.reserve(docs.size());
+        keys.resize(docs.size() * width);
+
+        for (ArrayIter it(docs); it; ++it) {
+            const Variant& value = it.secondRef();
+            if (!value.isString()) {
+                mongoThrow<MongoException>("bson_sort() expects an array of BSON strings");
+            }
+            cbson_init_static_from_string(&doc, value.toString());
+            cbson_sort_keys(&doc, spec, keys.data() + values.size() * width);
+            values.push_back(value);
+        }
+
+        std::vector<uint32_t> order(values.size());
+        for (uint32_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return cbson_compare_sort_keys(keys.data() + a * width,
+                                           keys.data() + b * width, spec) < 0;
+        });
+
+        Array ret = Array::Create();
+        for (auto i : order) {
+            ret.append(values[i]);
+        }
+        return ret;
+    }
+
     void MongoExtension::_initBSON() {
         HHVM_FE(bson_decode);
         HHVM_FE(bson_encode);
+        HHVM_FE(bson_get);
+        HHVM_FE(bson_has);
+        HHVM_FE(bson_compare);
+        HHVM_FE(bson_sort);
     }
 }
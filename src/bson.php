@@ -1,7 +1,82 @@
 <?hh
 
+/**
+ * Implemented by classes that a typemap decodes documents into. The decoder
+ * creates the object without calling its constructor and passes it the
+ * decoded fields.
+ */
+interface MongoBSONUnserializable {
+  public function bsonUnserialize(array $data);
+}
+
+/**
+ * Decodes a BSON document
+ *
+ * @param string $bson - bson    The BSON document.
+ * @param array $options - options    Decoding options. "typemap" maps
+ *   "root", "document" and "array" to "array", "object" (stdClass), a
+ *   class name or, on HHVM 3.18 and later, "dict" or "vec".
+ *   "fieldPaths" maps dotted paths to the same targets,
+ *   where a "$" component matches any key. Classes implementing
+ *   MongoBSONUnserializable receive the decoded fields through
+ *   bsonUnserialize(); other classes get them set as properties.
+ *   "integerObjects" decodes 32 and 64-bit integers as MongoInt32 and
+ *   MongoInt64, so encoding the document again keeps their BSON types.
+ *
+ * @return mixed - The decoded document.
+ */
 <<__Native>>
-function bson_decode(string $bson): array;
+function bson_decode(string $bson, array $options = array()): mixed;
 
 <<__Native>>
 function bson_encode(mixed $value): string;
+
+/**
+ * Returns a single field of a BSON document without decoding the rest of it
+ *
+ * @param string $bson - bson    The BSON document.
+ * @param string $path - path    Dotted path of the field, such as "a.b.0".
+ * @param mixed $default - default    Value returned when the path does
+ *   not exist.
+ *
+ * @return mixed - The decoded value, or $default.
+ */
+<<__Native>>
+function bson_get(string $bson, string $path, mixed $default = null): mixed;
+
+/**
+ * Checks whether a BSON document contains a field, without decoding it
+ *
+ * @param string $bson - bson    The BSON document.
+ * @param string $path - path    Dotted path of the field, such as "a.b.0".
+ *
+ * @return bool - Returns TRUE if the field exists, even when it is null.
+ */
+<<__Native>>
+function bson_has(string $bson, string $path): bool;
+
+/**
+ * Compares two BSON documents using MongoDB's sort order
+ *
+ * @param string $a - a    The first BSON document.
+ * @param string $b - b    The second BSON document.
+ * @param array $sort - sort    Fields to compare, in the same format as
+ *   MongoCursor::sort(): dotted paths mapped to 1 or -1.
+ *
+ * @return int - Returns -1, 0 or 1 as $a sorts before, with or after $b.
+ */
+<<__Native>>
+function bson_compare(string $a, string $b, array $sort): int;
+
+/**
+ * Sorts BSON documents using MongoDB's sort order
+ *
+ * @param array $docs - docs    An array of BSON strings.
+ * @param array $sort - sort    Fields to sort by, in the same format as
+ *   MongoCursor::sort(): dotted paths mapped to 1 or -1.
+ *
+ * @return array - Returns the documents in sorted order. The sort is
+ *   stable and the result is a list.
+ */
+<<__Native>>
+function bson_sort(array $docs, array $sort): array;
@@ -0,0 +1,319 @@
+#include <math.h>
+#include <string.h>
+#include "bson_compare.h"
+
+namespace HPHP {
+
+// Ordering of raw BSON values, following the server's canonical type order
+// (MinKey < null < numbers < strings < objects < arrays < BinData < ObjectId
+// < booleans < dates < timestamps < regexes < ... < MaxKey).
+// Reference: canonicalizeBSONType() in the server's bsontypes.cpp
+
+int
+cbson_canonical_type (bson_type_t type)
+{
+  switch (type) {
+  case BSON_TYPE_MINKEY:
+    return -1;
+  case BSON_TYPE_UNDEFINED:
+    return 0;
+  case BSON_TYPE_NULL:
+    return 5;
+  case BSON_TYPE_DOUBLE:
+  case BSON_TYPE_INT32:
+  case BSON_TYPE_INT64:
+    return 10;
+  case BSON_TYPE_UTF8:
+  case BSON_TYPE_SYMBOL:
+    return 15;
+  case BSON_TYPE_DOCUMENT:
+    return 20;
+  case BSON_TYPE_ARRAY:
+    return 25;
+  case BSON_TYPE_BINARY:
+    return 30;
+  case BSON_TYPE_OID:
+    return 35;
+  case BSON_TYPE_BOOL:
+    return 40;
+  case BSON_TYPE_DATE_TIME:
+    return 45;
+  case BSON_TYPE_TIMESTAMP:
+    return 47;
+  case BSON_TYPE_REGEX:
+    return 50;
+  case BSON_TYPE_DBPOINTER:
+    return 55;
+  case BSON_TYPE_CODE:
+    return 60;
+  case BSON_TYPE_CODEWSCOPE:
+    return 65;
+  case BSON_TYPE_MAXKEY:
+    return 127;
+  default:
+    return 0;
+  }
+}
+
+template <typename T>
+static int
+compare_scalars (T a, T b)
+{
+  return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int
+compare_bytes (const char *a, uint32_t a_len, const char *b, uint32_t b_len)
+{
+  int ret = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  if (ret != 0) {
+    return ret < 0 ? -1 : 1;
+  }
+  return compare_scalars(a_len, b_len);
+}
+
+static int
+compare_numbers (const bson_iter_t *a, const bson_iter_t *b)
+{
+  if (!BSON_ITER_HOLDS_DOUBLE(a) && !BSON_ITER_HOLDS_DOUBLE(b)) {
+    return compare_scalars(bson_iter_as_int64(a), bson_iter_as_int64(b));
+  }
+
+  double x = BSON_ITER_HOLDS_DOUBLE(a) ? bson_iter_double(a) : (double) bson_iter_as_int64(a);
+  double y = BSON_ITER_HOLDS_DOUBLE(b) ? bson_iter_double(b) : (double) bson_iter_as_int64(b);
+
+  // NaN sorts before every other number, as it does on the server
+  if (isnan(x)) {
+    return isnan(y) ? 0 : -1;
+  }
+  if (isnan(y)) {
+    return 1;
+  }
+  return compare_scalars(x, y);
+}
+
+// Documents and arrays compare element by element: canonical type first,
+// then field name, then value. A prefix sorts before the longer container.
+static int
+compare_containers (const bson_iter_t *a, const bson_iter_t *b)
+{
+  bson_iter_t a_child, b_child;
+
+  if (!bson_iter_recurse(a, &a_child) || !bson_iter_recurse(b, &b_child)) {
+    return 0;
+  }
+
+  while (true) {
+    bool a_more = bson_iter_next(&a_child);
+    bool b_more = bson_iter_next(&b_child);
+
+    if (!a_more || !b_more) {
+      return compare_scalars(a_more, b_more);
+    }
+
+    int ret = compare_scalars(cbson_canonical_type(bson_iter_type(&a_child)),
+                              cbson_canonical_type(bson_iter_type(&b_child)));
+    if (ret != 0) {
+      return ret;
+    }
+
+    ret = strcmp(bson_iter_key(&a_child), bson_iter_key(&b_child));
+    if (ret != 0) {
+      return ret < 0 ? -1 : 1;
+    }
+
+    ret = cbson_compare_values(&a_child, &b_child);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+}
+
+int
+cbson_compare_values (const bson_iter_t * a, const bson_iter_t * b)
+{
+  bson_type_t a_type = bson_iter_type(a);
+  bson_type_t b_type = bson_iter_type(b);
+
+  int ret = compare_scalars(cbson_canonical_type(a_type), cbson_canonical_type(b_type));
+  if (ret != 0) {
+    return ret;
+  }
+
+  uint32_t a_len, b_len;
+
+  switch (a_type) {
+  case BSON_TYPE_DOUBLE:
+  case BSON_TYPE_INT32:
+  case BSON_TYPE_INT64:
+    return compare_numbers(a, b);
+
+  case BSON_TYPE_UTF8:
+  case BSON_TYPE_SYMBOL:
+  {
+    const char *a_str = BSON_ITER_HOLDS_UTF8(a) ? bson_iter_utf8(a, &a_len) : bson_iter_symbol(a, &a_len);
+    const char *b_str = BSON_ITER_HOLDS_UTF8(b) ? bson_iter_utf8(b, &b_len) : bson_iter_symbol(b, &b_len);
+    return compare_bytes(a_str, a_len, b_str, b_len);
+  }
+
+  case BSON_TYPE_DOCUMENT:
+  case BSON_TYPE_ARRAY:
+    return compare_containers(a, b);
+
+  case BSON_TYPE_BINARY:
+  {
+    bson_subtype_t a_subtype, b_subtype;
+    const uint8_t *a_bin, *b_bin;
+    bson_iter_binary(a, &a_subtype, &a_len, &a_bin);
+    bson_iter_binary(b, &b_subtype, &b_len, &b_bin);
+
+    // Length first, then subtype, then the bytes themselves
+    ret = compare_scalars(a_len, b_len);
+    if (ret == 0) {
+      ret = compare_scalars((int) a_subtype, (int) b_subtype);
+    }
+    if (ret == 0) {
+      ret = compare_bytes((const char *) a_bin, a_len, (const char *) b_bin, b_len);
+    }
+    return ret;
+  }
+
+  case BSON_TYPE_OID:
+    ret = bson_oid_compare(bson_iter_oid(a), bson_iter_oid(b));
+    return compare_scalars(ret, 0);
+
+  case BSON_TYPE_BOOL:
+    return compare_scalars(bson_iter_bool(a), bson_iter_bool(b));
+
+  case BSON_TYPE_DATE_TIME:
+    return compare_scalars(bson_iter_date_time(a), bson_iter_date_time(b));
+
+  case BSON_TYPE_TIMESTAMP:
+  {
+    uint32_t a_ts, a_inc, b_ts, b_inc;
+    bson_iter_timestamp(a, &a_ts, &a_inc);
+    bson_iter_timestamp(b, &b_ts, &b_inc);
+    ret = compare_scalars(a_ts, b_ts);
+    return ret != 0 ? ret : compare_scalars(a_inc, b_inc);
+  }
+
+  case BSON_TYPE_REGEX:
+  {
+    const char *a_options, *b_options;
+    const char *a_regex = bson_iter_regex(a, &a_options);
+    const char *b_regex = bson_iter_regex(b, &b_options);
+    ret = strcmp(a_regex, b_regex);
+    if (ret == 0) {
+      ret = strcmp(a_options, b_options);
+    }
+    return compare_scalars(ret, 0);
+  }
+
+  case BSON_TYPE_DBPOINTER:
+  {
+    const char *a_coll, *b_coll;
+    const bson_oid_t *a_oid, *b_oid;
+    bson_iter_dbpointer(a, &a_len, &a_coll, &a_oid);
+    bson_iter_dbpointer(b, &b_len, &b_coll, &b_oid);
+    ret = compare_bytes(a_coll, a_len, b_coll, b_len);
+    return ret != 0 ? ret : compare_scalars(bson_oid_compare(a_oid, b_oid), 0);
+  }
+
+  case BSON_TYPE_CODE:
+  {
+    const char *a_code = bson_iter_code(a, &a_len);
+    const char *b_code = bson_iter_code(b, &b_len);
+    return compare_bytes(a_code, a_len, b_code, b_len);
+  }
+
+  case BSON_TYPE_CODEWSCOPE:
+  {
+    uint32_t a_scope_len, b_scope_len;
+    const uint8_t *a_scope, *b_scope;
+    const char *a_code = bson_iter_codewscope(a, &a_len, &a_scope_len, &a_scope);
+    const char *b_code = bson_iter_codewscope(b, &b_len, &b_scope_len, &b_scope);
+    ret = compare_bytes(a_code, a_len, b_code, b_len);
+    if (ret != 0) {
+      return ret;
+    }
+    return compare_bytes((const char *) a_scope, a_scope_len, (const char *) b_scope, b_scope_len);
+  }
+
+  default:
+    // MinKey, MaxKey, null and undefined carry no value
+    return 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sort keys
+
+void
+cbson_sort_spec_from_array (const Array& spec, cbson_sort_spec * out)
+{
+  for (ArrayIter it(spec); it; ++it) {
+    out->paths.push_back(it.first().toString().toCppString());
+    out->directions.push_back(it.second().toInt64() < 0 ? -1 : 1);
+  }
+}
+
+// Iterator over a value of a type that carries no data, e.g. null
+template <bson_type_t TYPE>
+static const bson_iter_t&
+valueless_sort_key ()
+{
+  static const uint8_t doc[] = { 7, 0, 0, 0, TYPE, 0, 0 };
+  static const bson_iter_t key = [] {
+    bson_t bson;
+    bson_iter_t iter;
+    bson_init_static(&bson, doc, sizeof(doc));
+    bson_iter_init(&iter, &bson);
+    bson_iter_next(&iter);
+    return iter;
+  }();
+  return key;
+}
+
+// Extracts one key per sort field. Missing fields sort as null. An array
+// sorts by its smallest element when ascending and by its largest when
+// descending; an empty one sorts as undefined, below null, like it does on
+// the server.
+void
+cbson_sort_keys (const bson_t * doc, const cbson_sort_spec& spec, bson_iter_t * keys)
+{
+  bson_iter_t root, child;
+
+  for (size_t i = 0; i < spec.paths.size(); i++) {
+    if (!bson_iter_init(&root, doc) ||
+        !bson_iter_find_descendant(&root, spec.paths[i].c_str(), &keys[i])) {
+      keys[i] = valueless_sort_key<BSON_TYPE_NULL>();
+      continue;
+    }
+
+    if (BSON_ITER_HOLDS_ARRAY(&keys[i]) && bson_iter_recurse(&keys[i], &child)) {
+      bool found = false;
+      bson_iter_t best;
+      while (bson_iter_next(&child)) {
+        if (!found || cbson_compare_values(&child, &best) * spec.directions[i] < 0) {
+          best = child;
+          found = true;
+        }
+      }
+      keys[i] = found ? best : valueless_sort_key<BSON_TYPE_UNDEFINED>();
+    }
+  }
+}
+
+int
+cbson_compare_sort_keys (const bson_iter_t * a, const bson_iter_t * b, const cbson_sort_spec& spec)
+{
+  for (size_t i = 0; i < spec.paths.size(); i++) {
+    int ret = cbson_compare_values(&a[i], &b[i]);
+    if (ret != 0) {
+      return ret * spec.directions[i];
+    }
+  }
+  return 0;
+}
+
+} // namespace HPHP
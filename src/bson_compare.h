@@ -0,0 +1,24 @@
+#ifndef incl_HPHP_EXT_MONGO_BSON_COMPARE_H_
+#define incl_HPHP_EXT_MONGO_BSON_COMPARE_H_
+
+#include "hphp/runtime/base/base-includes.h"
+#include <bson.h>
+#include <string>
+#include <vector>
+
+namespace HPHP {
+  // Parsed form of a sort specification such as array("a.b" => 1, "c" => -1)
+  struct cbson_sort_spec {
+    std::vector<std::string> paths;
+    std::vector<int> directions;
+  };
+
+  int cbson_canonical_type (bson_type_t type);
+  int cbson_compare_values (const bson_iter_t * a, const bson_iter_t * b);
+
+  void cbson_sort_spec_from_array (const Array& spec, cbson_sort_spec * out);
+  void cbson_sort_keys (const bson_t * doc, const cbson_sort_spec& spec, bson_iter_t * keys);
+  int cbson_compare_sort_keys (const bson_iter_t * a, const bson_iter_t * b, const cbson_sort_spec& spec);
+}
+
+#endif // incl_HPHP_EXT_MONGO_BSON_COMPARE_H_
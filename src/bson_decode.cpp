@@ -3,6 +3,7 @@
 #include "hphp/runtime/base/base-includes.h"
 #include "bson_decode.h"
 #include "ext_mongo.h"
+#include "mongo_types.h"
 
 namespace HPHP {
 
@@ -25,13 +26,48 @@ create_object(const StaticString * className, Array params)
   return obj;
 }
 
+const StaticString
+  s_MongoBSONUnserializable("MongoBSONUnserializable"),
+  s_bsonUnserialize("bsonUnserialize");
+
+// Decoding state handed to the visitors through their data pointer. Values
+// are written either into an array or directly into an object's properties.
+struct cbson_loads_state {
+  Array                     *array;
+  cbson_target::Kind         kind;    // Array, Dict or Vec
+  ObjectData                *object;
+  const StringData          *context; // class scope for private properties
+  const cbson_typemap_node  *node;
+  const cbson_loads_options *options;
+};
+
+static const cbson_loads_options s_default_options {};
+
+static inline void
+cbson_loads_add (void *output, const char *key, const Variant& value)
+{
+  cbson_loads_state *state = (cbson_loads_state *) output;
+
+  if (state->object) {
+    state->object->o_set(String(key), value, String(state->context));
+  } else if (state->kind == cbson_target::Kind::Array) {
+    state->array->add(String(key), value);
+  } else if (state->kind == cbson_target::Kind::Dict) {
+    // dict keys stay strings, even when they look like integers
+    state->array->set(String(key), value, true);
+  } else {
+    // vec ignores BSON keys
+    state->array->append(value);
+  }
+}
+
 static bool
 cbson_loads_visit_double (const bson_iter_t *iter,
                           const char        *key,
                           double             v_double,
                           void              *output)
 {
-  ((Array *) output)->add(String(key),v_double);
+  cbson_loads_add(output, key, v_double);
   return false;
 }
 
@@ -42,7 +78,7 @@ cbson_loads_visit_utf8 (const bson_iter_t *iter,
                         const char        *v_utf8,
                         void              *output)
 {
-  ((Array *) output)->add(String(key),v_utf8); 
+  cbson_loads_add(output, key, v_utf8);
   return false;
 }
 
@@ -69,14 +105,10 @@ cbson_loads_visit_binary (const bson_iter_t *iter,
                           const uint8_t     *v_binary,
                           void              *output)
 {
-  ObjectData * data = create_object(&s_MongoBinData,
-    make_packed_array(
-      String((const char*) v_binary, v_binary_len, CopyString),
-      (int) v_subtype));
-  ((Array *) output) -> add(String(key), data);
+  cbson_loads_add(output, key, mongo_bindata_create(
+    String((const char *) v_binary, v_binary_len, CopyString), v_subtype));
   return false;
-
-}                       
+}
 
 static bool
 cbson_loads_visit_oid (const bson_iter_t *iter,
@@ -88,7 +120,7 @@ cbson_loads_visit_oid (const bson_iter_t *iter,
   bson_oid_to_string(oid, id);
   ObjectData * data = create_object(&s_MongoId, 
     make_packed_array(String(id)));
-  ((Array *) output)->add(String(key), data);
+  cbson_loads_add(output, key, data);
   return false;
 }
 
@@ -98,7 +130,7 @@ cbson_loads_visit_bool (const bson_iter_t *iter,
                         bool              v_bool,
                         void              *output)
 {
-  ((Array *) output)->add(String(key), v_bool);
+  cbson_loads_add(output, key, v_bool);
   return false;
 }
 
@@ -108,13 +140,7 @@ cbson_loads_visit_date_time (const bson_iter_t *iter,
                              int64_t       msec_since_epoch,
                              void              *output)
 {
-  // Renaming for convenience
-  int64_t msec = msec_since_epoch;
-
-  ObjectData * data = create_object(&s_MongoDate,
-    make_packed_array(msec / 1000, (msec % 1000) * 1000));
-
-  ((Array *) output)->add(String(key), data);
+  cbson_loads_add(output, key, mongo_date_create(msec_since_epoch));
 
   return false;
 } 
@@ -124,7 +150,7 @@ cbson_loads_visit_null (const bson_iter_t *iter,
                         const char        *key,                          
                         void              *output)
 {
-  ((Array *) output)->add(String(key), Variant());
+  cbson_loads_add(output, key, Variant());
   return false;
 }
 
@@ -135,11 +161,7 @@ cbson_loads_visit_regex (const bson_iter_t *iter,
                          const char        *options,
                          void              *output)
 {
-  String regex_string = "/" + String(regex) + "/" + String(options);
-  ObjectData * data = create_object(&s_MongoRegex,
-    make_packed_array(regex_string));
-
-  ((Array *) output)->add(String(key), data); 
+  cbson_loads_add(output, key, mongo_regex_create(regex, options));
 
   return false;
 }
@@ -158,7 +180,7 @@ cbson_loads_visit_dbpointer (const bson_iter_t *iter,
     make_packed_array(
       String(v_collection, v_collection_len, CopyString),
       String(id)));
-  ((Array *)output)->add(String(key), data);
+  cbson_loads_add(output, key, data);
   return false;
   //TODO: Finish this
 }
@@ -172,7 +194,7 @@ cbson_loads_visit_code (const bson_iter_t *iter,
 {
   ObjectData * data = create_object(&s_MongoCode,
     make_packed_array(String(v_code, v_code_len, CopyString)));
-  ((Array *)output)->add(String(key), data);
+  cbson_loads_add(output, key, data);
   return false;
 }
 
@@ -182,7 +204,11 @@ cbson_loads_visit_int32 (const bson_iter_t *iter,
                          int32_t           v_int32,
                          void             *output)
 {
-  ((Array *) output)->add(String(key), v_int32);
+  if (((cbson_loads_state *) output)->options->integer_objects) {
+    cbson_loads_add(output, key, mongo_int32_create(v_int32));
+    return false;
+  }
+  cbson_loads_add(output, key, v_int32);
   return false;
 }
 
@@ -194,11 +220,7 @@ cbson_loads_visit_timestamp (const bson_iter_t *iter,
                              uint32_t          increment,
                              void              *output)
 {
-  ObjectData * data = create_object(&s_MongoTimestamp,
-    make_packed_array((int64_t)timestamp, (int64_t)increment));
-
-  ((Array *) output)->add(String(key), data);
-
+  cbson_loads_add(output, key, mongo_timestamp_create(timestamp, increment));
   return false;
 }
 
@@ -208,7 +230,11 @@ cbson_loads_visit_int64 (const bson_iter_t *iter,
                          int64_t          v_int64,
                          void              *output)
 {
-  ((Array *) output)->add(String(key),v_int64);  
+  if (((cbson_loads_state *) output)->options->integer_objects) {
+    cbson_loads_add(output, key, mongo_int64_create(v_int64));
+    return false;
+  }
+  cbson_loads_add(output, key, v_int64);
   return false;
 }
 
@@ -218,7 +244,7 @@ cbson_loads_visit_maxkey (const bson_iter_t *iter,
                           void              *output)
 {
   ObjectData * data = create_object(&s_MongoMaxKey, Array());
-  ((Array *)output)->add(String(key), data);
+  cbson_loads_add(output, key, data);
   return false;
 }
 
@@ -228,7 +254,7 @@ cbson_loads_visit_minkey (const bson_iter_t *iter,
                           void              *output)
 {
   ObjectData * data = create_object(&s_MongoMinKey, Array());
-  ((Array *)output)->add(String(key), data);
+  cbson_loads_add(output, key, data);
   return false;
 }
 
@@ -259,29 +285,110 @@ bson_visitor_t gLoadsVisitors = {
   cbson_loads_visit_minkey,
 };
 
+// Decodes a document or array into the target chosen by the typemap
+static bool
+cbson_loads_container (const bson_t              *bson,
+                       const cbson_target&        target,
+                       const cbson_typemap_node  *node,
+                       const cbson_loads_options *options,
+                       Variant                   *out)
+{
+  bson_iter_t child;
+  cbson_loads_state state = { nullptr, target.kind, nullptr, nullptr, node, options };
+
+  if (!bson_iter_init(&child, bson)) {
+    return false;
+  }
+
+  if (target.kind == cbson_target::Kind::Object && !target.unserializable) {
+    // Plain classes get their properties set while decoding, in one pass
+    Object obj(ObjectData::newInstance(target.cls));
+    state.object = obj.get();
+    state.context = target.cls->name();
+    if (bson_iter_visit_all(&child, &gLoadsVisitors, &state)) {
+      return false;
+    }
+    *out = obj;
+    return true;
+  }
+
+  // Hack arrays are filled directly rather than converted from a PHP array
+  Array arr;
+  switch (target.kind) {
+#ifdef MONGO_HAVE_HACK_ARRAYS
+  case cbson_target::Kind::Dict:
+    arr = Array::CreateDict();
+    break;
+  case cbson_target::Kind::Vec:
+    arr = Array::CreateVec();
+    break;
+#endif
+  default:
+    arr = Array::Create();
+    state.kind = cbson_target::Kind::Array;
+    break;
+  }
+
+  state.array = &arr;
+  if (bson_iter_visit_all(&child, &gLoadsVisitors, &state)) {
+    return false;
+  }
+
+  if (target.kind == cbson_target::Kind::Object) {
+    Object obj(ObjectData::newInstance(target.cls));
+    obj->o_invoke_few_args(s_bsonUnserialize, 1, arr);
+    *out = obj;
+  } else {
+    *out = arr;
+  }
+  return true;
+}
+
+static const cbson_typemap_node *
+cbson_typemap_child (const cbson_typemap_node *node, const char *key)
+{
+  if (!node || node->children.empty()) {
+    return nullptr;
+  }
+
+  auto it = node->children.find(key);
+  if (it == node->children.end()) {
+    it = node->children.find("$");
+  }
+  return it == node->children.end() ? nullptr : it->second.get();
+}
+
+static bool
+cbson_loads_visit_nested (const char   *key,
+                          const bson_t *v_nested,
+                          bool          is_array,
+                          void         *data)
+{
+  cbson_loads_state *state = (cbson_loads_state *) data;
+  const cbson_typemap_node *node = cbson_typemap_child(state->node, key);
+  const cbson_typemap& typemap = state->options->typemap;
+  Variant value;
+
+  const cbson_target& target = (node && node->has_target) ? node->target :
+    (is_array ? typemap.array : typemap.document);
+
+  if (cbson_loads_container(v_nested, target, node, state->options, &value)) {
+    cbson_loads_add(data, key, value);
+  }
+  return false;
+}
+
 static bool
 cbson_loads_visit_document (const bson_iter_t *iter,
                             const char        *key,
                             const bson_t      *v_document,
                             void              *data)
 {
-  bson_iter_t child;
-  Array * ret = (Array *) data;
-  Array obj;
-
   bson_return_val_if_fail(iter, true);
   bson_return_val_if_fail(key, true);
   bson_return_val_if_fail(v_document, true);
 
-  if (bson_iter_init(&child, v_document))
-  {
-    obj = Array();
-    if (!bson_iter_visit_all(&child, &gLoadsVisitors, &obj))
-    {
-      ret->add(String(key), obj);
-    }
-  }
-  return false;
+  return cbson_loads_visit_nested(key, v_document, false, data);
 }
 
 static bool
@@ -290,62 +397,253 @@ cbson_loads_visit_array (const bson_iter_t *iter,
                          const bson_t      *v_array,
                          void              *data)
 {
-  bson_iter_t child;
-  Array * ret = (Array *) data;
-  Array obj;
-
   bson_return_val_if_fail(iter, true);
   bson_return_val_if_fail(key, true);
   bson_return_val_if_fail(v_array, true);
 
-  if (bson_iter_init(&child, v_array))
+  return cbson_loads_visit_nested(key, v_array, true, data);
+}
+
+// Decodes a single element through the same visitors used for whole
+// documents, so that a value looked up on its own decodes exactly as it
+// would inside cbson_loads()
+static bool
+cbson_loads_visit_element (const bson_iter_t *iter,
+                           const char        *key,
+                           void              *output)
+{
+  bson_t sub;
+  uint32_t len;
+  const uint8_t *buf;
+
+  switch (bson_iter_type(iter)) {
+  case BSON_TYPE_DOUBLE:
+    return cbson_loads_visit_double(iter, key, bson_iter_double(iter), output);
+  case BSON_TYPE_UTF8:
   {
-    obj = Array();
-    if (!bson_iter_visit_all(&child, &gLoadsVisitors, &obj))
-    {
-      ret->add(String(key), obj);
+    const char *v_utf8 = bson_iter_utf8(iter, &len);
+    return cbson_loads_visit_utf8(iter, key, len, v_utf8, output);
+  }
+  case BSON_TYPE_DOCUMENT:
+    bson_iter_document(iter, &len, &buf);
+    if (!bson_init_static(&sub, buf, len)) {
+      return true;
     }
+    return cbson_loads_visit_document(iter, key, &sub, output);
+  case BSON_TYPE_ARRAY:
+    bson_iter_array(iter, &len, &buf);
+    if (!bson_init_static(&sub, buf, len)) {
+      return true;
+    }
+    return cbson_loads_visit_array(iter, key, &sub, output);
+  case BSON_TYPE_BINARY:
+  {
+    bson_subtype_t subtype;
+    bson_iter_binary(iter, &subtype, &len, &buf);
+    return cbson_loads_visit_binary(iter, key, subtype, len, buf, output);
+  }
+  case BSON_TYPE_OID:
+    return cbson_loads_visit_oid(iter, key, bson_iter_oid(iter), output);
+  case BSON_TYPE_BOOL:
+    return cbson_loads_visit_bool(iter, key, bson_iter_bool(iter), output);
+  case BSON_TYPE_DATE_TIME:
+    return cbson_loads_visit_date_time(iter, key, bson_iter_date_time(iter), output);
+  case BSON_TYPE_NULL:
+    return cbson_loads_visit_null(iter, key, output);
+  case BSON_TYPE_REGEX:
+  {
+    const char *options;
+    const char *regex = bson_iter_regex(iter, &options);
+    return cbson_loads_visit_regex(iter, key, regex, options, output);
+  }
+  case BSON_TYPE_DBPOINTER:
+  {
+    const char *collection;
+    const bson_oid_t *oid;
+    bson_iter_dbpointer(iter, &len, &collection, &oid);
+    return cbson_loads_visit_dbpointer(iter, key, len, collection, oid, output);
+  }
+  case BSON_TYPE_CODE:
+  {
+    const char *code = bson_iter_code(iter, &len);
+    return cbson_loads_visit_code(iter, key, len, code, output);
+  }
+  case BSON_TYPE_INT32:
+    return cbson_loads_visit_int32(iter, key, bson_iter_int32(iter), output);
+  case BSON_TYPE_TIMESTAMP:
+  {
+    uint32_t timestamp, increment;
+    bson_iter_timestamp(iter, &timestamp, &increment);
+    return cbson_loads_visit_timestamp(iter, key, timestamp, increment, output);
+  }
+  case BSON_TYPE_INT64:
+    return cbson_loads_visit_int64(iter, key, bson_iter_int64(iter), output);
+  case BSON_TYPE_MAXKEY:
+    return cbson_loads_visit_maxkey(iter, key, output);
+  case BSON_TYPE_MINKEY:
+    return cbson_loads_visit_minkey(iter, key, output);
+  default:
+    // Same types that gLoadsVisitors leaves unhandled
+    return false;
   }
-  return false;
 }
 
-Array
-cbson_loads (const bson_t * bson) 
+Variant
+cbson_loads_value (const bson_iter_t * iter)
 {
-  bson_iter_t iter;
-
   Array ret = Array();
+  cbson_loads_state state = { &ret, cbson_target::Kind::Array, nullptr, nullptr, nullptr, &s_default_options };
 
-  if (!bson_iter_init(&iter, bson))
-  {
-    mongoThrow<MongoException>("Failed to initialize BSON iterator");
+  cbson_loads_visit_element(iter, bson_iter_key(iter), &state);
+
+  ArrayIter it(ret);
+  if (!it) {
+    return init_null_variant;
   }
-  bson_iter_visit_all(&iter, &gLoadsVisitors, &ret);
+  return it.second();
+}
 
-  return ret;
+void
+cbson_init_static_from_string (bson_t * bson, const String& str)
+{
+  if (!bson_init_static(bson, (const uint8_t *)str.data(), str.size())) {
+    mongoThrow<MongoException>("Unexpected end of BSON. Input document is likely corrupted!");
+  }
 }
 
+Variant
+cbson_loads (const bson_t * bson, const cbson_loads_options * options)
+{
+  Variant ret;
 
+  if (!cbson_loads_container(bson, options->typemap.root,
+                             &options->typemap.paths, options, &ret)) {
+    mongoThrow<MongoException>("Failed to initialize BSON iterator");
+  }
+  return ret;
+}
 
 Array
-cbson_loads_from_string (const String& bson) 
+cbson_loads (const bson_t * bson) 
+{
+  return cbson_loads(bson, &s_default_options).toArray();
+}
+
+Variant
+cbson_loads_from_string (const String& bson, const cbson_loads_options * options)
 {
   bson_reader_t * reader;
   const bson_t * obj;
   bool reached_eof;
 
-  Array output = Array();
-
   reader = bson_reader_new_from_data((uint8_t *)bson.c_str(), bson.size());
   
   if (!(obj = bson_reader_read(reader, &reached_eof))) {
+    bson_reader_destroy(reader);
     mongoThrow<MongoException>("Unexpected end of BSON. Input document is likely corrupted!");
   }  
 
-  output = cbson_loads(obj);
+  Variant output = cbson_loads(obj, options);
   bson_reader_destroy(reader);
 
   return output;
 }
+
+Array
+cbson_loads_from_string (const String& bson) 
+{
+  return cbson_loads_from_string(bson, &s_default_options).toArray();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Decode options
+
+static void
+cbson_target_from_variant (const Variant& spec, cbson_target * target)
+{
+  String name = spec.toString();
+
+  if (name == "array") {
+    target->kind = cbson_target::Kind::Array;
+    return;
+  }
+
+  // keyset is not a target: it only holds ints and strings, and documents
+  // hold any value
+  if (name == "dict" || name == "vec") {
+#ifdef MONGO_HAVE_HACK_ARRAYS
+    target->kind = name == "dict" ? cbson_target::Kind::Dict : cbson_target::Kind::Vec;
+    return;
+#else
+    mongoThrow<MongoException>(("Typemap target " + name + " requires HHVM 3.18 or later").c_str());
+#endif
+  }
+
+  Class *cls = name == "object" ? SystemLib::s_stdclassClass : Unit::loadClass(name.get());
+  if (cls == nullptr) {
+    mongoThrow<MongoException>(("Typemap class " + name + " does not exist").c_str());
+  }
+
+  Class *unserializable = Unit::lookupClass(s_MongoBSONUnserializable.get());
+  target->kind = cbson_target::Kind::Object;
+  target->cls = cls;
+  target->unserializable = unserializable && cls->classof(unserializable);
+}
+
+static void
+cbson_typemap_from_array (const Array& spec, cbson_typemap * typemap)
+{
+  if (spec.exists(String("root"))) {
+    cbson_target_from_variant(spec[String("root")], &typemap->root);
+  }
+  if (spec.exists(String("document"))) {
+    cbson_target_from_variant(spec[String("document")], &typemap->document);
+  }
+  if (spec.exists(String("array"))) {
+    cbson_target_from_variant(spec[String("array")], &typemap->array);
+  }
+
+  // "a.b" => "Cls" becomes a path through the trie, so decoding only
+  // follows child pointers instead of building dotted strings
+  Array paths = spec[String("fieldPaths")].toArray();
+  for (ArrayIter it(paths); it; ++it) {
+    std::string path = it.first().toString().toCppString();
+    cbson_typemap_node *node = &typemap->paths;
+    size_t start = 0;
+
+    while (true) {
+      size_t dot = path.find('.', start);
+      std::string component = path.substr(start, dot == std::string::npos ? dot : dot - start);
+      auto& child = node->children[component];
+      if (!child) {
+        child.reset(new cbson_typemap_node());
+      }
+      node = child.get();
+      if (dot == std::string::npos) {
+        break;
+      }
+      start = dot + 1;
+    }
+
+    node->has_target = true;
+    cbson_target_from_variant(it.second(), &node->target);
+  }
+}
+
+void
+cbson_loads_options_from_array (const Array& options, cbson_loads_options * out)
+{
+  if (options.exists(String("typemap"))) {
+    cbson_typemap_from_array(options[String("typemap")].toArray(), &out->typemap);
+  }
+  if (options.exists(String("integerObjects"))) {
+    out->integer_objects = options[String("integerObjects")].toBoolean();
+  }
+}
+
+BSONDecodeOptions::BSONDecodeOptions(const Array& options) {
+  cbson_loads_options_from_array(options, &m_options);
+}
+
 // Namespace
 }
\ No newline at end of file
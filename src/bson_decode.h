@@ -1,8 +1,76 @@
+#ifndef incl_HPHP_EXT_MONGO_BSON_DECODE_H_
+#define incl_HPHP_EXT_MONGO_BSON_DECODE_H_
+
 #include "hphp/runtime/base/base-includes.h"
+#include "hphp/runtime/version.h"
 #include <bson.h>
+#include <map>
+#include <memory>
+#include <string>
+
+// dict and vec arrays exist from HHVM 3.18
+#if HHVM_VERSION_MAJOR > 3 || (HHVM_VERSION_MAJOR == 3 && HHVM_VERSION_MINOR >= 18)
+#define MONGO_HAVE_HACK_ARRAYS 1
+#endif
 
 namespace HPHP {
+  // What a BSON document or array is decoded into
+  struct cbson_target {
+    enum class Kind { Array, Object, Dict, Vec };
+
+    Kind kind = Kind::Array;
+    Class *cls = nullptr;       // Object: class to instantiate
+    bool unserializable = false; // Object: class implements MongoBSONUnserializable
+  };
+
+  // One component of a typemap field path; "$" matches any key
+  struct cbson_typemap_node {
+    std::map<std::string, std::unique_ptr<cbson_typemap_node>> children;
+    bool has_target = false;
+    cbson_target target;
+  };
+
+  // Typemap compiled once from its array form, e.g.
+  // array("root" => "Entity", "document" => "object",
+  //       "fieldPaths" => array("items.$" => "Item"))
+  struct cbson_typemap {
+    cbson_target root;
+    cbson_target document;
+    cbson_target array;
+    cbson_typemap_node paths;
+  };
+
+  struct cbson_loads_options {
+    cbson_typemap typemap;
+    // Integers come back as MongoInt32 and MongoInt64 objects, so they are
+    // written back with their original BSON type
+    bool integer_objects = false;
+  };
+
+  // Compiled decode options kept alive alongside a cursor
+  class BSONDecodeOptions : public SweepableResourceData {
+  public:
+    explicit BSONDecodeOptions(const Array& options);
+
+    CLASSNAME_IS("bson decode options")
+
+    // overriding ResourceData
+    virtual const String& o_getClassNameHook() const { return classnameof(); }
+
+    const cbson_loads_options *get() const { return &m_options; }
+
+  private:
+    cbson_loads_options m_options;
+  };
+
+  void cbson_loads_options_from_array (const Array& options, cbson_loads_options * out);
+
   Array cbson_loads_from_string(const String& bson);
+  Variant cbson_loads_from_string(const String& bson, const cbson_loads_options * options);
   Array cbson_loads (const bson_t * bson);
-  
+  Variant cbson_loads (const bson_t * bson, const cbson_loads_options * options);
+  Variant cbson_loads_value (const bson_iter_t * iter);
+  void cbson_init_static_from_string (bson_t * bson, const String& str);
 }
+
+#endif // incl_HPHP_EXT_MONGO_BSON_DECODE_H_
@@ -10,6 +10,7 @@
 #include <bson.h>
 #include "encode.h"
 #include "classes.h"
+#include "../mongo_types.h"
 
 namespace HPHP {
 void fillBSONWithArray(const Array& value, bson_t* bson) {
@@ -121,17 +122,17 @@ void objectToBSON(const Object& value, const char* key, bson_t* bson) {
 //////////////////////////////////////////////////////////////////////////////
 
 void mongoTimestampToBSON(const Object& value, const char* key, bson_t* bson) {
-    bson_append_timestamp(bson, key, -1,
-      value->o_get("sec").toInt64(),
-      value->o_get("inc").toInt64()
-    );
+    uint32_t sec, inc;
+
+    mongo_timestamp_get(value, &sec, &inc);
+    bson_append_timestamp(bson, key, -1, sec, inc);
 }
 
 void mongoRegexToBSON(const Object& value, const char* key, bson_t* bson) {
-    bson_append_regex(bson, key, -1,
-      value->o_get("regex").toString().c_str(),
-      value->o_get("flags").toString().c_str()
-    );
+    String pattern, flags;
+
+    mongo_regex_get(value, &pattern, &flags);
+    bson_append_regex(bson, key, -1, pattern.c_str(), flags.c_str());
 }
 
 void mongoIdToBSON(const Object& value, const char* key, bson_t* bson) {
@@ -141,11 +142,7 @@ void mongoIdToBSON(const Object& value, const char* key, bson_t* bson) {
 }
 
 void mongoDateToBSON(const Object& value, const char* key, bson_t* bson) {
-    int64_t mili = 
-      (value->o_get("sec").toInt64() * 1000) + 
-      (value->o_get("usec").toInt64() / 1000);
-
-    bson_append_date_time(bson, key, -1, mili);
+    bson_append_date_time(bson, key, -1, mongo_date_msec(value));
 }
 
 void mongoCodeToBSON(const Object& value, const char* key, bson_t* bson) {
@@ -163,21 +160,19 @@ void mongoCodeToBSON(const Object& value, const char* key, bson_t* bson) {
 }
 
 void mongoBinDataToBSON(const Object& value, const char* key, bson_t* bson) {
-  const String& binary = value->o_get("bin").toString();
+  int type;
 
-  bson_append_binary(bson, key, -1, 
-    (bson_subtype_t) value->o_get("type").toInt32(),
-    (const uint8_t*) binary.c_str(), 
-    binary.size()
-  );
+  String binary = mongo_bindata_get(value, &type);
+  bson_append_binary(bson, key, -1, (bson_subtype_t) type,
+    (const uint8_t*) binary.data(), binary.size());
 }
 
 void mongoInt32ToBSON(const Object& value, const char* key, bson_t* bson) {
-  bson_append_int32(bson, key, -1, value->o_get("value").toInt32());
+  bson_append_int32(bson, key, -1, mongo_int32_value(value));
 }
 
 void mongoInt64ToBSON(const Object& value, const char* key, bson_t* bson) {
-  bson_append_int64(bson, key, -1, value->o_get("value").toInt64());
+  bson_append_int64(bson, key, -1, mongo_int64_value(value));
 }
 
 void mongoMinKeyToBSON(const char* key, bson_t* bson) {
@@ -4,6 +4,6 @@
 * Thrown when attempting to insert a document into a collection which
 * already contains the same values for the unique keys.
 */
-class MongoDuplicateKeyException extends MongoException
+class MongoDuplicateKeyException extends MongoWriteConcernException
 {
 }
\ No newline at end of file
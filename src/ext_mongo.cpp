@@ -1,4 +1,8 @@
 #include "ext_mongo.h"
+#include "mongo_counters.h"
+#include "mongo_resolver.h"
+#include "mongo_spool.h"
+#include "mongo_write_queue.h"
 
 namespace HPHP {
 
@@ -17,6 +21,54 @@ HPHP::Class* MongoWriteConcernException::cls = nullptr;
 HPHP::Class* MongoClient::cls = nullptr;
 HPHP::Class* MongoCursor::cls = nullptr;
 HPHP::Class* MongoCollection::cls = nullptr;
+HPHP::Class* MongoMatcher::cls = nullptr;
+
+const StaticString
+  s_Exception("Exception"),
+  s_message("message"),
+  s_code("code");
+
+void mongoInitException(const Object& exception, const String& message, int64_t code) {
+  // The backtrace is already collected by the instance initializer HHVM
+  // runs for every Exception; only the constructor call is saved here
+  exception->o_set(s_message, message, s_Exception);
+  exception->o_set(s_code, code, s_Exception);
+}
+
+void mongoThrowError(const bson_error_t& error) {
+  const char *message = error.message;
+
+  switch (error.domain) {
+  case MONGOC_ERROR_CLIENT:
+  case MONGOC_ERROR_STREAM:
+#if MONGOC_CHECK_VERSION(1, 2, 0)
+  // "No suitable servers found", from libmongoc 1.2 on
+  case MONGOC_ERROR_SERVER_SELECTION:
+#endif
+    mongoThrow<MongoConnectionException>(message, error.code);
+  case MONGOC_ERROR_PROTOCOL:
+    mongoThrow<MongoProtocolException>(message, error.code);
+  default:
+    break;
+  }
+
+  // Server error codes, passed through by libmongoc
+  switch (error.code) {
+  case 11000:
+  case 11001:
+  case 12582:
+    mongoThrow<MongoDuplicateKeyException>(message, error.code);
+  case 50:
+    mongoThrow<MongoExecutionTimeoutException>(message, error.code);
+  default:
+    break;
+  }
+
+  if (error.domain == MONGOC_ERROR_WRITE_CONCERN) {
+    mongoThrow<MongoWriteConcernException>(message, error.code);
+  }
+  mongoThrow<MongoCursorException>(message, error.code);
+}
 
 static void mongoc_log_handler(mongoc_log_level_t log_level,
                                const char *log_domain, const char *message,
@@ -35,10 +87,27 @@ void MongoExtension::moduleInit() {
   _initMongoClientClass();
   _initMongoCursorClass();
   _initMongoCollectionClass();
+  _initMongoDBClass();
+  _initMongoMatcherClass();
+  _initMongoOplogTailerClass();
+  _initMongoWriteQueueClass();
+  _initMongoSpoolClass();
+  _initMongoShardedClientClass();
+  _initMongoTypes();
   _initBSON();
   loadSystemlib();
 }
 
+void MongoExtension::moduleShutdown() {
+  // Coalesced counters and queued inserts still pending are written
+  // before the process exits
+  mongo_counters_shutdown();
+  mongo_write_queue_shutdown();
+  mongo_spool_shutdown();
+  mongo_resolver_shutdown();
+  destroy_client_pools();
+}
+
 MongoExtension s_mongo_extension;
 HHVM_GET_MODULE(mongo);
 
@@ -6,6 +6,11 @@ namespace HPHP {
 
     //////////////////////////////////////////////////////////////////////////////
     // PHP Exceptions and Classes (adapted from Imagick core extension)
+
+    // Sets what Exception::__construct would, without calling into PHP;
+    // the Mongo exception classes don't define constructors of their own
+    void mongoInitException(const Object& exception, const String& message, int64_t code);
+
 #define MONGO_DEFINE_CLASS(CLS) \
   class CLS { \
    public: \
@@ -16,15 +21,9 @@ namespace HPHP {
       return ObjectData::newInstance(cls); \
     } \
     \
-    static Object allocObject(const Variant& arg) { \
+    static Object allocObject(const String& message, int64_t code) { \
       Object ret = allocObject(); \
-      ret->incRefCount();\
-      ret->incRefCount();\
-      TypedValue dummy; \
-      g_context->invokeFunc(&dummy, \
-                              cls->getCtor(), \
-                              make_packed_array(arg), \
-                              ret.get()); \
+      mongoInitException(ret, message, code); \
       return ret; \
      } \
     \
@@ -50,20 +49,23 @@ namespace HPHP {
     MONGO_DEFINE_CLASS(MongoClient)
     MONGO_DEFINE_CLASS(MongoCursor)
     MONGO_DEFINE_CLASS(MongoCollection)
+    MONGO_DEFINE_CLASS(MongoMatcher)
 
 #undef MONGO_DEFINE_CLASS
     
     
     template<typename T>
-    void mongoThrow(const char* message);
+    [[noreturn]] void mongoThrow(const char* message, int64_t code = 0);
 
     template<typename T>
-    void mongoThrow(const char* message) {
-        std::string msg(message);
-        throw T::allocObject(msg);
-        
+    void mongoThrow(const char* message, int64_t code) {
+        throw T::allocObject(String(message, CopyString), code);
     }
 
+    // Throws the exception class matching a libmongoc or server error, e.g.
+    // MongoDuplicateKeyException for code 11000, with the error's code
+    [[noreturn]] void mongoThrowError(const bson_error_t& error);
+
   
     //////////////////////////////////////////////////////////////////////////////
 
@@ -71,11 +73,19 @@ namespace HPHP {
     public:
         MongoExtension();
         virtual void moduleInit();
+        virtual void moduleShutdown();
 
     private:
         void _initMongoClientClass();
         void _initMongoCursorClass();
         void _initMongoCollectionClass();
+        void _initMongoDBClass();
+        void _initMongoMatcherClass();
+        void _initMongoOplogTailerClass();
+        void _initMongoWriteQueueClass();
+        void _initMongoSpoolClass();
+        void _initMongoShardedClientClass();
+        void _initMongoTypes();
         void _initBSON();
     };
 
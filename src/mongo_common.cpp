@@ -1,4 +1,8 @@
 #include "mongo_common.h"
+#include "mongo_resolver.h"
+#include <ctype.h>
+#include <map>
+#include <mutex>
 #include <string>
 
 namespace HPHP {
@@ -39,10 +43,13 @@ void MongocClient::SetCachedImpl(const char *name, const String& uri, MongocClie
   g_persistentResources->set(name, uri.data(), client);
 }
 
-MongocClient::MongocClient(const String &uri) {
+MongocClient::MongocClient(const String &uri) : m_uri(uri.toCppString()) {
   m_client = mongoc_client_new(uri.c_str());
   if(!m_client){
       m_client = nullptr;
+  } else {
+    // Member connections resolve host names through the shared cache
+    mongoc_client_set_stream_initiator(m_client, mongo_stream_initiator, m_client);
   }
 }
 
@@ -52,6 +59,127 @@ MongocClient::~MongocClient() {
   }
 }
 
+MongocClient *get_persistent_client(const String& uri, bool *created) {
+  MongocClient *client = MongocClient::GetPersistent(uri);
+  *created = false;
+
+  if (client == nullptr) {
+    client = new MongocClient(uri);
+    *created = true;
+  }
+  if (client->isInvalid()) {
+    return nullptr;
+  }
+
+  MongocClient::SetPersistent(uri, client);
+  return client;
+}
+
+static std::string uri_escape(const std::string& value) {
+  static const char hex[] = "0123456789ABCDEF";
+  std::string ret;
+
+  for (unsigned char c : value) {
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || c == ',') {
+      ret += c;
+    } else {
+      ret += '%';
+      ret += hex[c >> 4];
+      ret += hex[c & 15];
+    }
+  }
+  return ret;
+}
+
+std::string uri_with_credentials(const std::string& uri, const std::string& username,
+                                 const std::string& password, const std::string& auth_source) {
+  static const std::string scheme = "mongodb://";
+  std::string rest = uri.compare(0, scheme.size(), scheme) == 0 ? uri.substr(scheme.size()) : uri;
+
+  // Credentials already in the string are replaced
+  size_t hosts_end = rest.find_first_of("/?");
+  size_t at = rest.rfind('@', hosts_end);
+  if (at != std::string::npos) {
+    rest = rest.substr(at + 1);
+    hosts_end = rest.find_first_of("/?");
+  }
+
+  return uri_with_option(scheme + uri_escape(username) + ":" + uri_escape(password) + "@" + rest,
+                         "authSource", auth_source);
+}
+
+std::string uri_with_option(const std::string& uri, const std::string& name,
+                            const std::string& value) {
+  size_t hosts_start = uri.find("://");
+  hosts_start = hosts_start == std::string::npos ? 0 : hosts_start + 3;
+  size_t hosts_end = uri.find_first_of("/?", hosts_start);
+
+  std::string ret = uri;
+  if (hosts_end == std::string::npos) {
+    ret += "/";
+  } else if (ret[hosts_end] == '?') {
+    ret.insert(hosts_end, "/");
+  }
+  ret += ret.find('?') == std::string::npos ? "?" : "&";
+  return ret + name + "=" + uri_escape(value);
+}
+
+bool is_connectivity_error(const bson_error_t& error) {
+  switch (error.domain) {
+  case MONGOC_ERROR_CLIENT:
+  case MONGOC_ERROR_STREAM:
+#if MONGOC_CHECK_VERSION(1, 2, 0)
+  case MONGOC_ERROR_SERVER_SELECTION:
+#endif
+    return true;
+  default:
+    break;
+  }
+
+  // The server stepped down or is shutting down
+  switch (error.code) {
+  case 91:    // ShutdownInProgress
+  case 189:   // PrimarySteppedDown
+  case 10058: // not master, from servers before 2.6
+  case 10107: // NotMaster
+  case 11600: // InterruptedAtShutdown
+  case 11602: // InterruptedDueToReplStateChange
+  case 13435: // NotMasterNoSlaveOk
+  case 13436: // NotMasterOrSecondary
+    return true;
+  default:
+    return false;
+  }
+}
+
+static std::mutex s_client_pools_lock;
+static std::map<std::string, mongoc_client_pool_t *> s_client_pools;
+
+mongoc_client_pool_t *get_client_pool(const std::string& uri) {
+  std::lock_guard<std::mutex> guard(s_client_pools_lock);
+  auto it = s_client_pools.find(uri);
+  if (it != s_client_pools.end()) {
+    return it->second;
+  }
+
+  mongoc_uri_t *parsed = mongoc_uri_new(uri.c_str());
+  if (!parsed) {
+    return nullptr;
+  }
+  mongoc_client_pool_t *pool = mongoc_client_pool_new(parsed);
+  mongoc_uri_destroy(parsed);
+  s_client_pools[uri] = pool;
+  return pool;
+}
+
+void destroy_client_pools() {
+  std::lock_guard<std::mutex> guard(s_client_pools_lock);
+  for (auto& pool : s_client_pools) {
+    mongoc_client_pool_destroy(pool.second);
+  }
+  s_client_pools.clear();
+}
+
 ////////MongocCursor
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -5,6 +5,7 @@
 #include "hphp/runtime/base/persistent-resource-store.h"
 #include "mongoc.h"
 #include "string.h"
+#include <string>
 
 namespace HPHP {
 
@@ -34,14 +35,43 @@ public:
   virtual bool isInvalid() const { return m_client == nullptr; }
 
   mongoc_client_t *get() { return m_client;}
+  const std::string& uri() const { return m_uri; }
+
+  // Whether a command has succeeded with the credentials in the uri
+  bool verified() const { return m_verified; }
+  void setVerified() { m_verified = true; }
 
 private:
   mongoc_client_t *m_client;
+  std::string m_uri;
+  bool m_verified = false;
 
 };
 
 MongocClient *get_client(Object obj);
 
+// Persistent client for a connection string, created on first use; null if
+// the string does not parse. *created tells whether it is new.
+MongocClient *get_persistent_client(const String& uri, bool *created);
+
+// Connection string carrying credentials, so that libmongoc authenticates
+// each socket of the client once, as it connects
+std::string uri_with_credentials(const std::string& uri, const std::string& username,
+                                 const std::string& password, const std::string& auth_source);
+
+// Connection string with an option added to its query string
+std::string uri_with_option(const std::string& uri, const std::string& name,
+                            const std::string& value);
+
+// True when an operation failed because no primary could be reached, as
+// opposed to the server rejecting it, e.g. for a duplicate key
+bool is_connectivity_error(const bson_error_t& error);
+
+// Process-wide pools for driver threads that write outside of a request,
+// where the request's mongoc_client_t cannot be shared
+mongoc_client_pool_t *get_client_pool(const std::string& uri);
+void destroy_client_pools();
+
 
 
 
@@ -0,0 +1,316 @@
+#include "mongo_counters.h"
+#include "mongo_common.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace HPHP {
+
+#define MONGO_COUNTER_STRIPES 64
+
+////////////////////////////////////////////////////////////////////////////////
+// Lock-striped delta table
+
+namespace {
+
+struct CounterKey {
+  std::string uri;
+  std::string ns;
+  std::string id;    // raw BSON of {"_id": ...}
+  std::string field;
+
+  bool operator==(const CounterKey& other) const {
+    return id == other.id && field == other.field &&
+           ns == other.ns && uri == other.uri;
+  }
+};
+
+struct CounterKeyHash {
+  size_t operator()(const CounterKey& key) const {
+    std::hash<std::string> h;
+    size_t seed = h(key.id);
+    seed ^= h(key.field) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= h(key.ns) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    return seed;
+  }
+};
+
+struct CounterDelta {
+  int64_t int_delta = 0;
+  double double_delta = 0;
+  bool is_double = false;
+
+  void merge(const CounterDelta& other) {
+    int_delta += other.int_delta;
+    double_delta += other.double_delta;
+    is_double = is_double || other.is_double;
+  }
+};
+
+typedef std::unordered_map<CounterKey, CounterDelta, CounterKeyHash> CounterMap;
+
+// uri -> ns -> document -> field deltas
+typedef std::map<std::string, std::map<std::string, std::map<std::string,
+  std::vector<std::pair<std::string, CounterDelta>>>>> CounterBatches;
+
+struct CounterStripe {
+  std::mutex lock;
+  CounterMap deltas;
+};
+
+CounterStripe s_stripes[MONGO_COUNTER_STRIPES];
+std::atomic<int64_t> s_pending(0);
+
+std::mutex s_options_lock;
+MongoCounterOptions s_options;
+
+// Serializes the flush thread with explicit flushes
+std::mutex s_flush_lock;
+
+std::mutex s_thread_lock;
+std::condition_variable s_wakeup;
+std::thread s_thread;
+bool s_thread_started = false;
+bool s_stopping = false;
+
+void append_delta(bson_t *inc, const std::string& field, const CounterDelta& delta) {
+  if (delta.is_double) {
+    bson_append_double(inc, field.c_str(), field.size(), delta.double_delta + delta.int_delta);
+  } else {
+    bson_append_int64(inc, field.c_str(), field.size(), delta.int_delta);
+  }
+}
+
+void put_back(const CounterKey& key, const CounterDelta& delta) {
+  auto& stripe = s_stripes[CounterKeyHash()(key) % MONGO_COUNTER_STRIPES];
+  std::lock_guard<std::mutex> guard(stripe.lock);
+  auto ret = stripe.deltas.emplace(key, delta);
+  if (ret.second) {
+    s_pending++;
+  } else {
+    ret.first->second.merge(delta);
+  }
+}
+
+int64_t write_batches(CounterBatches& batches, bool keep_failed, std::string *error);
+
+// Sleeps until the flush interval has passed since the last flush or too
+// many deltas are pending. Reconfiguring wakes it up to recompute its
+// deadline, without flushing early.
+void flush_thread() {
+  std::unique_lock<std::mutex> lock(s_thread_lock);
+  auto last_flush = std::chrono::steady_clock::now();
+
+  while (!s_stopping) {
+    MongoCounterOptions options = mongo_counters_options();
+    auto deadline = last_flush + std::chrono::milliseconds(
+      options.flush_interval_ms > 0 ? options.flush_interval_ms : 1000);
+
+    if (std::chrono::steady_clock::now() < deadline && s_pending < options.max_pending) {
+      s_wakeup.wait_until(lock, deadline);
+      continue;
+    }
+
+    lock.unlock();
+    std::string error;
+    mongo_counters_flush(&error);
+    lock.lock();
+    last_flush = std::chrono::steady_clock::now();
+  }
+}
+
+void ensure_thread() {
+  std::lock_guard<std::mutex> guard(s_thread_lock);
+  if (!s_thread_started && !s_stopping) {
+    s_thread = std::thread(flush_thread);
+    s_thread_started = true;
+  }
+}
+
+bool add(const std::string& uri, const std::string& ns, const bson_t *id,
+         const std::string& field, const CounterDelta& delta,
+         std::string *error) {
+  CounterKey key {uri, ns, std::string((const char *) bson_get_data(id), id->len), field};
+  MongoCounterOptions options = mongo_counters_options();
+
+  // Written through, the caller only pays for its own key, along with
+  // whatever was still pending for it. A failed write is reported to the
+  // caller rather than kept, as no thread would flush it.
+  if (options.flush_interval_ms <= 0) {
+    CounterDelta total = delta;
+    auto& stripe = s_stripes[CounterKeyHash()(key) % MONGO_COUNTER_STRIPES];
+    {
+      std::lock_guard<std::mutex> guard(stripe.lock);
+      auto pending = stripe.deltas.find(key);
+      if (pending != stripe.deltas.end()) {
+        total.merge(pending->second);
+        stripe.deltas.erase(pending);
+        s_pending--;
+      }
+    }
+
+    CounterBatches batches;
+    batches[key.uri][key.ns][key.id].emplace_back(key.field, total);
+    write_batches(batches, false, error);
+    return error->empty();
+  }
+
+  put_back(key, delta);
+  ensure_thread();
+  if (s_pending >= options.max_pending) {
+    s_wakeup.notify_one();
+  }
+  return true;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void mongo_counters_configure(const MongoCounterOptions& options) {
+  {
+    std::lock_guard<std::mutex> guard(s_options_lock);
+    s_options = options;
+  }
+  s_wakeup.notify_one();
+}
+
+MongoCounterOptions mongo_counters_options() {
+  std::lock_guard<std::mutex> guard(s_options_lock);
+  return s_options;
+}
+
+bool mongo_counters_add(const std::string& uri, const std::string& ns,
+                        const bson_t *id, const std::string& field,
+                        int64_t delta, std::string *error) {
+  CounterDelta d;
+  d.int_delta = delta;
+  return add(uri, ns, id, field, d, error);
+}
+
+bool mongo_counters_add(const std::string& uri, const std::string& ns,
+                        const bson_t *id, const std::string& field,
+                        double delta, std::string *error) {
+  CounterDelta d;
+  d.double_delta = delta;
+  d.is_double = true;
+  return add(uri, ns, id, field, d, error);
+}
+
+int64_t mongo_counters_flush(std::string *error) {
+  CounterBatches batches;
+
+  for (auto& stripe : s_stripes) {
+    CounterMap taken;
+    {
+      std::lock_guard<std::mutex> guard(stripe.lock);
+      taken.swap(stripe.deltas);
+    }
+    s_pending -= taken.size();
+    for (auto& entry : taken) {
+      batches[entry.first.uri][entry.first.ns][entry.first.id].emplace_back(entry.first.field, entry.second);
+    }
+  }
+
+  return write_batches(batches, mongo_counters_options().retry_failed, error);
+}
+
+namespace {
+
+int64_t write_batches(CounterBatches& batches, bool keep_failed, std::string *error) {
+  if (batches.empty()) {
+    return 0;
+  }
+
+  MongoCounterOptions options = mongo_counters_options();
+  std::lock_guard<std::mutex> guard(s_flush_lock);
+  int64_t updated = 0;
+
+  mongoc_write_concern_t *write_concern = mongoc_write_concern_new();
+  mongoc_write_concern_set_w(write_concern, options.w);
+
+  for (auto& by_uri : batches) {
+    mongoc_client_pool_t *pool = get_client_pool(by_uri.first);
+    mongoc_client_t *client = pool ? mongoc_client_pool_pop(pool) : nullptr;
+
+    for (auto& by_ns : by_uri.second) {
+      bool ok = false;
+
+      if (client) {
+        size_t dot = by_ns.first.find('.');
+        mongoc_collection_t *collection = mongoc_client_get_collection(
+          client, by_ns.first.substr(0, dot).c_str(), by_ns.first.substr(dot + 1).c_str());
+        mongoc_bulk_operation_t *bulk = mongoc_collection_create_bulk_operation(collection, false, write_concern);
+
+        // One upsert per document, with every coalesced field in its $inc
+        for (auto& by_id : by_ns.second) {
+          bson_t selector, update, inc;
+          bson_init_static(&selector, (const uint8_t *) by_id.first.data(), by_id.first.size());
+          bson_init(&update);
+          bson_append_document_begin(&update, "$inc", 4, &inc);
+          for (auto& field : by_id.second) {
+            append_delta(&inc, field.first, field.second);
+          }
+          bson_append_document_end(&update, &inc);
+          mongoc_bulk_operation_update(bulk, &selector, &update, true);
+          bson_destroy(&update);
+        }
+
+        bson_t reply;
+        bson_error_t bulk_error;
+        ok = mongoc_bulk_operation_execute(bulk, &reply, &bulk_error);
+        if (ok) {
+          updated += by_ns.second.size();
+        } else if (error) {
+          *error = bulk_error.message;
+        }
+        bson_destroy(&reply);
+        mongoc_bulk_operation_destroy(bulk);
+        mongoc_collection_destroy(collection);
+      } else if (error) {
+        *error = "Invalid counter connection string: " + by_uri.first;
+      }
+
+      // An unordered bulk may have applied part of the upserts, so
+      // retrying trades possible double counting for not losing deltas
+      if (!ok && client && keep_failed) {
+        for (auto& by_id : by_ns.second) {
+          for (auto& field : by_id.second) {
+            put_back(CounterKey {by_uri.first, by_ns.first, by_id.first, field.first}, field.second);
+          }
+        }
+      }
+    }
+
+    if (client) {
+      mongoc_client_pool_push(pool, client);
+    }
+  }
+
+  mongoc_write_concern_destroy(write_concern);
+  return updated;
+}
+
+} // namespace
+
+void mongo_counters_shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(s_thread_lock);
+    s_stopping = true;
+  }
+  s_wakeup.notify_one();
+  if (s_thread.joinable()) {
+    s_thread.join();
+  }
+
+  std::string error;
+  mongo_counters_flush(&error);
+}
+
+} // namespace HPHP
@@ -0,0 +1,42 @@
+#ifndef incl_HPHP_EXT_MONGO_COUNTERS_H_
+#define incl_HPHP_EXT_MONGO_COUNTERS_H_
+
+#include <stdint.h>
+#include <string>
+#include "mongoc.h"
+
+namespace HPHP {
+
+// Process-wide coalescing of $inc updates. Deltas for the same document
+// and field are summed in a lock-striped table and written as one
+// unordered bulk of upserts per collection by a background thread.
+struct MongoCounterOptions {
+  int64_t flush_interval_ms = 1000; // 0 writes each increment through, key by key
+  int64_t max_pending = 10000;      // pending (document, field) pairs that trigger an early flush
+  int32_t w = MONGOC_WRITE_CONCERN_W_DEFAULT;
+  bool retry_failed = true;         // keep deltas of a failed bulk for the next flush
+};
+
+void mongo_counters_configure(const MongoCounterOptions& options);
+MongoCounterOptions mongo_counters_options();
+
+// id is a BSON document holding only the _id of the target document.
+// Returns false with error set if a write-through failed; its delta is
+// dropped, not kept for a later flush.
+bool mongo_counters_add(const std::string& uri, const std::string& ns,
+                        const bson_t *id, const std::string& field,
+                        int64_t delta, std::string *error);
+bool mongo_counters_add(const std::string& uri, const std::string& ns,
+                        const bson_t *id, const std::string& field,
+                        double delta, std::string *error);
+
+// Writes all pending deltas from the calling thread; returns the number
+// of documents updated. error is set if any bulk failed.
+int64_t mongo_counters_flush(std::string *error);
+
+// Stops the flush thread after a final flush
+void mongo_counters_shutdown();
+
+} // namespace HPHP
+
+#endif // incl_HPHP_EXT_MONGO_COUNTERS_H_
@@ -0,0 +1,101 @@
+#include "mongo_metadata_cache.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+
+namespace HPHP {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct CacheEntry {
+  Clock::time_point expires;
+  MongoMetadata docs;
+};
+
+std::mutex s_cache_lock;
+int64_t s_ttl_ms = 0;
+
+// Ordered, so that the entries of a database are contiguous
+std::map<std::string, CacheEntry> s_cache;
+
+std::string cache_key(const std::string& uri, const std::string& key) {
+  return uri + '\0' + key;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void mongo_metadata_cache_set_ttl(int64_t ttl_ms) {
+  std::lock_guard<std::mutex> guard(s_cache_lock);
+  s_ttl_ms = ttl_ms > 0 ? ttl_ms : 0;
+  if (s_ttl_ms == 0) {
+    s_cache.clear();
+  }
+}
+
+int64_t mongo_metadata_cache_ttl() {
+  std::lock_guard<std::mutex> guard(s_cache_lock);
+  return s_ttl_ms;
+}
+
+MongoMetadata mongo_metadata_cache_get(const std::string& uri, const std::string& key) {
+  std::lock_guard<std::mutex> guard(s_cache_lock);
+
+  auto it = s_cache.find(cache_key(uri, key));
+  if (it == s_cache.end()) {
+    return nullptr;
+  }
+  if (it->second.expires <= Clock::now()) {
+    s_cache.erase(it);
+    return nullptr;
+  }
+  return it->second.docs;
+}
+
+void mongo_metadata_cache_put(const std::string& uri, const std::string& key,
+                              MongoMetadata docs) {
+  std::lock_guard<std::mutex> guard(s_cache_lock);
+
+  if (s_ttl_ms == 0) {
+    return;
+  }
+  s_cache[cache_key(uri, key)] = CacheEntry {
+    Clock::now() + std::chrono::milliseconds(s_ttl_ms), docs
+  };
+}
+
+MongoMetadata mongo_metadata_from_cursor(mongoc_cursor_t *cursor, bson_error_t *error) {
+  auto docs = std::make_shared<std::vector<std::string>>();
+  const bson_t *doc;
+
+  // The command cursor fetches further batches with getMore as needed
+  while (mongoc_cursor_next(cursor, &doc)) {
+    docs->emplace_back((const char *) bson_get_data(doc), doc->len);
+  }
+  if (mongoc_cursor_error(cursor, error)) {
+    return nullptr;
+  }
+  return docs;
+}
+
+void mongo_metadata_cache_invalidate(const std::string& uri, const std::string& db) {
+  std::lock_guard<std::mutex> guard(s_cache_lock);
+
+  if (uri.empty()) {
+    s_cache.clear();
+    return;
+  }
+
+  // The database's own entry, then those of its namespaces
+  s_cache.erase(cache_key(uri, db));
+  std::string prefix = cache_key(uri, db + ".");
+  auto it = s_cache.lower_bound(prefix);
+  while (it != s_cache.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+    it = s_cache.erase(it);
+  }
+}
+
+} // namespace HPHP
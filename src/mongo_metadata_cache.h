@@ -0,0 +1,34 @@
+#ifndef incl_HPHP_EXT_MONGO_METADATA_CACHE_H_
+#define incl_HPHP_EXT_MONGO_METADATA_CACHE_H_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mongoc.h"
+
+namespace HPHP {
+
+// Process-wide cache of collection and index listings. An entry holds the
+// raw BSON documents returned by listCollections (keyed by database name)
+// or listIndexes (keyed by namespace) for one connection string, and
+// expires after the TTL. A TTL of 0, the default, disables the cache.
+typedef std::shared_ptr<const std::vector<std::string>> MongoMetadata;
+
+void mongo_metadata_cache_set_ttl(int64_t ttl_ms);
+int64_t mongo_metadata_cache_ttl();
+
+MongoMetadata mongo_metadata_cache_get(const std::string& uri, const std::string& key);
+void mongo_metadata_cache_put(const std::string& uri, const std::string& key,
+                              MongoMetadata docs);
+
+// Drains a listCollections/listIndexes cursor; null on error
+MongoMetadata mongo_metadata_from_cursor(mongoc_cursor_t *cursor, bson_error_t *error);
+
+// Drops the collection listing of a database and the index listings of
+// its collections; an empty uri drops everything
+void mongo_metadata_cache_invalidate(const std::string& uri, const std::string& db);
+
+} // namespace HPHP
+
+#endif // incl_HPHP_EXT_MONGO_METADATA_CACHE_H_
@@ -0,0 +1,337 @@
+#include "mongo_resolver.h"
+#include "mongo_wire_stats.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace HPHP {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Address {
+  sockaddr_storage addr;
+  socklen_t len;
+  int family;
+};
+
+struct Entry {
+  std::string host;
+  uint16_t port;
+  std::vector<Address> addresses; // empty for a cached failure
+  std::string error;
+  Clock::time_point expires;
+  bool refreshing = false;
+};
+
+std::mutex s_lock;
+MongoResolverOptions s_options;
+std::unordered_map<std::string, Entry> s_entries;
+
+std::condition_variable s_wake;
+std::deque<std::string> s_refresh_queue;
+std::thread s_thread;
+bool s_stopping = false;
+
+std::atomic<int64_t> s_hits {0};
+std::atomic<int64_t> s_misses {0};
+std::atomic<int64_t> s_stale_hits {0};
+std::atomic<int64_t> s_negative_hits {0};
+std::atomic<int64_t> s_refreshes {0};
+std::atomic<int64_t> s_refresh_failures {0};
+
+std::string entry_key(const std::string& host, uint16_t port) {
+  return host + ":" + std::to_string(port);
+}
+
+bool resolve(const std::string& host, uint16_t port,
+             std::vector<Address> *addresses, std::string *error) {
+  struct addrinfo hints, *result;
+  char service[8];
+
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(service, sizeof service, "%hu", port);
+
+  int rc = getaddrinfo(host.c_str(), service, &hints, &result);
+  if (rc != 0) {
+    *error = gai_strerror(rc);
+    return false;
+  }
+
+  for (struct addrinfo *rp = result; rp; rp = rp->ai_next) {
+    Address address;
+    memcpy(&address.addr, rp->ai_addr, rp->ai_addrlen);
+    address.len = rp->ai_addrlen;
+    address.family = rp->ai_family;
+    addresses->push_back(address);
+  }
+  freeaddrinfo(result);
+  return true;
+}
+
+// Called with s_lock held
+void store(Entry& entry, bool ok, std::vector<Address>& addresses, const std::string& error) {
+  auto now = Clock::now();
+
+  if (ok) {
+    entry.addresses.swap(addresses);
+    entry.error.clear();
+    entry.expires = now + std::chrono::milliseconds(s_options.ttl_ms);
+  } else {
+    // Good addresses outlive a resolver hiccup; the lookup is retried
+    // after the negative TTL either way
+    if (entry.addresses.empty()) {
+      entry.error = error;
+    }
+    entry.expires = now + std::chrono::milliseconds(s_options.negative_ttl_ms);
+  }
+}
+
+void refresh_thread() {
+  std::unique_lock<std::mutex> lock(s_lock);
+
+  for (;;) {
+    s_wake.wait(lock, [] { return s_stopping || !s_refresh_queue.empty(); });
+    if (s_stopping) {
+      return;
+    }
+
+    std::string key = s_refresh_queue.front();
+    s_refresh_queue.pop_front();
+    auto it = s_entries.find(key);
+    if (it == s_entries.end()) {
+      continue;
+    }
+    std::string host = it->second.host;
+    uint16_t port = it->second.port;
+
+    lock.unlock();
+    std::vector<Address> addresses;
+    std::string error;
+    bool ok = resolve(host, port, &addresses, &error);
+    lock.lock();
+
+    s_refreshes++;
+    if (!ok) {
+      s_refresh_failures++;
+    }
+    // The entry may have been cleared meanwhile
+    it = s_entries.find(key);
+    if (it != s_entries.end()) {
+      it->second.refreshing = false;
+      store(it->second, ok, addresses, error);
+    }
+  }
+}
+
+bool lookup(const std::string& host, uint16_t port,
+            std::vector<Address> *addresses, std::string *error) {
+  std::string key = entry_key(host, port);
+  std::unique_lock<std::mutex> lock(s_lock);
+
+  if (!s_options.enabled) {
+    lock.unlock();
+    return resolve(host, port, addresses, error);
+  }
+
+  auto it = s_entries.find(key);
+  if (it != s_entries.end()) {
+    Entry& entry = it->second;
+
+    if (Clock::now() < entry.expires) {
+      if (entry.addresses.empty()) {
+        s_negative_hits++;
+        *error = entry.error;
+        return false;
+      }
+      s_hits++;
+      *addresses = entry.addresses;
+      return true;
+    }
+
+    if (!entry.addresses.empty()) {
+      s_stale_hits++;
+      if (!entry.refreshing && !s_stopping) {
+        entry.refreshing = true;
+        s_refresh_queue.push_back(key);
+        if (!s_thread.joinable()) {
+          s_thread = std::thread(refresh_thread);
+        }
+        s_wake.notify_one();
+      }
+      *addresses = entry.addresses;
+      return true;
+    }
+  }
+
+  // Never resolved, or an expired failure
+  s_misses++;
+  lock.unlock();
+  std::vector<Address> resolved;
+  bool ok = resolve(host, port, &resolved, error);
+  lock.lock();
+
+  Entry& entry = s_entries[key];
+  entry.host = host;
+  entry.port = port;
+  if (ok) {
+    *addresses = resolved;
+  }
+  store(entry, ok, resolved, *error);
+  return ok;
+}
+
+// After a failed connect the addresses may be out of date; the next
+// lookup serves them once more and resolves the host in the background
+void mark_stale(const std::string& host, uint16_t port) {
+  std::lock_guard<std::mutex> guard(s_lock);
+
+  auto it = s_entries.find(entry_key(host, port));
+  if (it != s_entries.end()) {
+    it->second.expires = Clock::now();
+  }
+}
+
+int64_t connect_timeout_ms(const mongoc_uri_t *uri) {
+  const bson_t *options = mongoc_uri_get_options(uri);
+  bson_iter_t iter;
+
+  if (options && bson_iter_init_find_case(&iter, options, "connecttimeoutms") &&
+      BSON_ITER_HOLDS_INT32(&iter)) {
+    return bson_iter_int32(&iter);
+  }
+  return MONGOC_DEFAULT_CONNECTTIMEOUTMS;
+}
+
+// Co-located servers, e.g. mongodb://%2Ftmp%2Fmongodb-27017.sock, skip
+// the TCP stack and ephemeral ports; host->host holds the socket path
+mongoc_stream_t *connect_unix(const mongoc_host_list_t *host, int64_t expire_at,
+                              bson_error_t *error) {
+  struct sockaddr_un addr;
+
+  if (strlen(host->host) >= sizeof addr.sun_path) {
+    bson_set_error(error, MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_INVALID_TYPE,
+                   "Socket path is too long: %s", host->host);
+    return nullptr;
+  }
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, host->host);
+
+  mongoc_socket_t *sock = mongoc_socket_new(AF_UNIX, SOCK_STREAM, 0);
+  if (sock && mongoc_socket_connect(sock, (struct sockaddr *) &addr, sizeof addr, expire_at) == 0) {
+    mongo_wire_stats_connect(AF_UNIX, true);
+    return mongo_wire_stats_stream_new(
+      mongoc_stream_buffered_new(mongoc_stream_socket_new(sock), 1024));
+  }
+  if (sock) {
+    mongoc_socket_destroy(sock);
+  }
+
+  mongo_wire_stats_connect(AF_UNIX, false);
+  bson_set_error(error, MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_CONNECT,
+                 "Failed to connect to UNIX domain socket: %s", host->host);
+  return nullptr;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void mongo_resolver_configure(const MongoResolverOptions& options) {
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_options = options;
+}
+
+MongoResolverOptions mongo_resolver_options() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  return s_options;
+}
+
+MongoResolverStats mongo_resolver_stats() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  return MongoResolverStats {
+    (int64_t) s_entries.size(), s_hits, s_misses, s_stale_hits,
+    s_negative_hits, s_refreshes, s_refresh_failures
+  };
+}
+
+void mongo_resolver_clear() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_entries.clear();
+}
+
+mongoc_stream_t *mongo_stream_initiator(const mongoc_uri_t *uri,
+                                        const mongoc_host_list_t *host,
+                                        void *user_data,
+                                        bson_error_t *error) {
+  // TLS takes libmongoc's own path
+  if (mongoc_uri_get_ssl(uri)) {
+    mongoc_stream_t *stream = mongoc_client_default_stream_initiator(uri, host, user_data, error);
+    mongo_wire_stats_connect(host->family, stream != nullptr);
+    return mongo_wire_stats_stream_new(stream);
+  }
+
+  int64_t expire_at = bson_get_monotonic_time() + connect_timeout_ms(uri) * 1000;
+
+  if (host->family == AF_UNIX) {
+    return connect_unix(host, expire_at, error);
+  }
+
+  std::vector<Address> addresses;
+  std::string message;
+  if (!lookup(host->host, host->port, &addresses, &message)) {
+    bson_set_error(error, MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_NAME_RESOLUTION,
+                   "Failed to resolve %s: %s", host->host, message.c_str());
+    return nullptr;
+  }
+
+  for (auto& address : addresses) {
+    mongoc_socket_t *sock = mongoc_socket_new(address.family, SOCK_STREAM, 0);
+    if (!sock) {
+      continue;
+    }
+    if (mongoc_socket_connect(sock, (struct sockaddr *) &address.addr, address.len, expire_at) == 0) {
+      int flag = 1;
+      mongoc_socket_setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof flag);
+      mongo_wire_stats_connect(address.family, true);
+      return mongo_wire_stats_stream_new(
+        mongoc_stream_buffered_new(mongoc_stream_socket_new(sock), 1024));
+    }
+    mongoc_socket_destroy(sock);
+  }
+
+  mark_stale(host->host, host->port);
+  mongo_wire_stats_connect(AF_INET, false);
+  bson_set_error(error, MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_CONNECT,
+                 "Failed to connect to target host: %s", host->host_and_port);
+  return nullptr;
+}
+
+void mongo_resolver_shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    s_stopping = true;
+  }
+  s_wake.notify_one();
+  if (s_thread.joinable()) {
+    s_thread.join();
+  }
+}
+
+} // namespace HPHP
@@ -0,0 +1,52 @@
+#ifndef incl_HPHP_EXT_MONGO_RESOLVER_H_
+#define incl_HPHP_EXT_MONGO_RESOLVER_H_
+
+#include <stdint.h>
+#include <string>
+#include "mongoc.h"
+
+namespace HPHP {
+
+// Process-wide cache of host name resolutions for the connections of
+// persistent clients. Expired entries are still served while a background
+// thread resolves them again, and a failed refresh keeps the last good
+// addresses, so a reconnect only blocks on DNS for a host never resolved.
+// Failures are cached for a shorter time.
+struct MongoResolverOptions {
+  bool enabled = true;
+  int64_t ttl_ms = 60000;
+  int64_t negative_ttl_ms = 5000;
+};
+
+struct MongoResolverStats {
+  int64_t entries;
+  int64_t hits;
+  int64_t misses;
+  int64_t stale_hits;
+  int64_t negative_hits;
+  int64_t refreshes;
+  int64_t refresh_failures;
+};
+
+void mongo_resolver_configure(const MongoResolverOptions& options);
+MongoResolverOptions mongo_resolver_options();
+MongoResolverStats mongo_resolver_stats();
+
+// Drops every entry
+void mongo_resolver_clear();
+
+// Stream initiator for mongoc_client_set_stream_initiator(), connecting
+// over TCP or a Unix domain socket; user_data is the mongoc_client_t, for
+// TLS connections left to libmongoc. Streams are counted in the wire
+// statistics.
+mongoc_stream_t *mongo_stream_initiator(const mongoc_uri_t *uri,
+                                        const mongoc_host_list_t *host,
+                                        void *user_data,
+                                        bson_error_t *error);
+
+// Stops the refresh thread
+void mongo_resolver_shutdown();
+
+} // namespace HPHP
+
+#endif // incl_HPHP_EXT_MONGO_RESOLVER_H_
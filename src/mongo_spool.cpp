@@ -0,0 +1,528 @@
+#include "mongo_spool.h"
+#include "mongo_common.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace HPHP {
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+// Segment files
+//
+// A segment is a fixed-size, zero-filled file holding BSON documents back
+// to back; a zero length marks the end of the written part. The checkpoint
+// file holds the segment number and offset of the first document that has
+// not been replayed yet.
+
+struct Segment {
+  int fd = -1;
+  uint8_t *map = nullptr;
+  size_t size = 0;
+
+  bool open(const std::string& path, size_t create_size, bool writable) {
+    fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) {
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close();
+      return false;
+    }
+    size = st.st_size;
+    if (writable && size < create_size) {
+      if (ftruncate(fd, create_size) != 0) {
+        close();
+        return false;
+      }
+      size = create_size;
+    }
+    if (size == 0) {
+      return true;
+    }
+
+    void *data = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      close();
+      return false;
+    }
+    map = (uint8_t *) data;
+    return true;
+  }
+
+  void close() {
+    if (map) {
+      munmap(map, size);
+      map = nullptr;
+    }
+    if (fd >= 0) {
+      ::close(fd);
+      fd = -1;
+    }
+    size = 0;
+  }
+
+  // Length of the document at offset, or 0 at the end of the written part
+  uint32_t documentAt(size_t offset) const {
+    if (!map || offset + 5 > size) {
+      return 0;
+    }
+    uint32_t len;
+    memcpy(&len, map + offset, 4);
+    len = BSON_UINT32_FROM_LE(len);
+    if (len < 5 || offset + len > size || map[offset + len - 1] != 0) {
+      return 0;
+    }
+    return len;
+  }
+
+  size_t end() const {
+    size_t offset = 0;
+    uint32_t len;
+    while ((len = documentAt(offset))) {
+      offset += len;
+    }
+    return offset;
+  }
+};
+
+struct Spool {
+  std::string uri;
+  std::string ns;
+  std::string dir;
+
+  // Writer state
+  std::mutex write_lock;
+  Segment writer;
+  uint64_t w_segment = 1;
+  size_t w_offset = 0;
+
+  // Replay state, i.e. the checkpoint
+  std::mutex replay_lock;
+  uint64_t r_segment = 1;
+  size_t r_offset = 0;
+
+  std::atomic<bool> has_pending {false};
+  std::atomic<int64_t> spooled {0};
+  std::atomic<int64_t> replayed {0};
+  std::atomic<int64_t> pending_bytes {0};
+
+  std::mutex error_lock;
+  std::string last_error;
+
+  std::string segmentPath(uint64_t segment) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%012llu.seg", (unsigned long long) segment);
+    return dir + name;
+  }
+
+  std::string checkpointPath() const {
+    return dir + "/checkpoint";
+  }
+
+  void setError(const std::string& error) {
+    std::lock_guard<std::mutex> guard(error_lock);
+    last_error = error;
+  }
+};
+
+std::mutex s_options_lock;
+MongoSpoolOptions s_options;
+
+std::mutex s_spools_lock;
+std::map<std::string, std::unique_ptr<Spool>> s_spools;
+
+std::mutex s_thread_lock;
+std::condition_variable s_wakeup;
+std::thread s_thread;
+bool s_thread_started = false;
+bool s_stopping = false;
+
+std::string spool_key(const std::string& uri, const std::string& ns) {
+  return uri + '\0' + ns;
+}
+
+Spool *find_spool(const std::string& uri, const std::string& ns) {
+  std::lock_guard<std::mutex> guard(s_spools_lock);
+  auto it = s_spools.find(spool_key(uri, ns));
+  return it == s_spools.end() ? nullptr : it->second.get();
+}
+
+// Written to a temporary file first so a crash never leaves a torn one
+bool write_checkpoint(Spool *spool) {
+  std::string tmp = spool->checkpointPath() + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+  fprintf(f, "%llu %llu\n", (unsigned long long) spool->r_segment,
+          (unsigned long long) spool->r_offset);
+  bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+  fclose(f);
+  return ok && rename(tmp.c_str(), spool->checkpointPath().c_str()) == 0;
+}
+
+void recover(Spool *spool, int64_t segment_bytes) {
+  std::vector<uint64_t> segments;
+
+  if (DIR *d = opendir(spool->dir.c_str())) {
+    while (struct dirent *entry = readdir(d)) {
+      unsigned long long n;
+      char suffix[8];
+      if (sscanf(entry->d_name, "%llu.%4s", &n, suffix) == 2 && strcmp(suffix, "seg") == 0) {
+        segments.push_back(n);
+      }
+    }
+    closedir(d);
+  }
+  std::sort(segments.begin(), segments.end());
+
+  spool->r_segment = segments.empty() ? 1 : segments.front();
+  spool->r_offset = 0;
+  if (FILE *f = fopen(spool->checkpointPath().c_str(), "r")) {
+    unsigned long long segment, offset;
+    if (fscanf(f, "%llu %llu", &segment, &offset) == 2) {
+      spool->r_segment = segment;
+      spool->r_offset = offset;
+    }
+    fclose(f);
+  }
+
+  spool->w_segment = segments.empty() ? spool->r_segment : segments.back();
+  if (!spool->writer.open(spool->segmentPath(spool->w_segment), segment_bytes, true)) {
+    spool->setError(std::string("Unable to open spool segment: ") + strerror(errno));
+    return;
+  }
+  // Clear anything after the last complete document, e.g. a torn write
+  spool->w_offset = spool->writer.end();
+  memset(spool->writer.map + spool->w_offset, 0, spool->writer.size - spool->w_offset);
+
+  int64_t pending = 0;
+  for (uint64_t segment : segments) {
+    if (segment < spool->r_segment || segment >= spool->w_segment) {
+      continue;
+    }
+    Segment reader;
+    if (reader.open(spool->segmentPath(segment), 0, false)) {
+      pending += reader.end();
+      reader.close();
+    }
+  }
+  pending += spool->w_offset;
+  if (spool->r_segment <= spool->w_segment) {
+    pending -= spool->r_offset;
+  }
+  spool->pending_bytes = std::max<int64_t>(0, pending);
+  spool->has_pending = spool->pending_bytes > 0;
+}
+
+uint32_t inserted_count(const bson_t *reply) {
+  bson_iter_t iter;
+  if (bson_iter_init_find(&iter, reply, "nInserted") &&
+      (BSON_ITER_HOLDS_INT32(&iter) || BSON_ITER_HOLDS_INT64(&iter))) {
+    return (uint32_t) bson_iter_as_int64(&iter);
+  }
+  return 0;
+}
+
+int64_t replay(Spool *spool) {
+  std::lock_guard<std::mutex> guard(spool->replay_lock);
+  MongoSpoolOptions options = mongo_spool_options();
+  int64_t total = 0;
+
+  mongoc_client_pool_t *pool = get_client_pool(spool->uri);
+  if (!pool) {
+    spool->setError("Invalid connection string: " + spool->uri);
+    return 0;
+  }
+  mongoc_client_t *client = mongoc_client_pool_pop(pool);
+  size_t dot = spool->ns.find('.');
+  mongoc_collection_t *collection = mongoc_client_get_collection(
+    client, spool->ns.substr(0, dot).c_str(), spool->ns.substr(dot + 1).c_str());
+
+  for (;;) {
+    uint64_t w_segment;
+    size_t w_offset;
+    {
+      std::lock_guard<std::mutex> write_guard(spool->write_lock);
+      w_segment = spool->w_segment;
+      w_offset = spool->w_offset;
+      if (spool->r_segment == w_segment && spool->r_offset >= w_offset) {
+        spool->has_pending = false;
+        break;
+      }
+    }
+
+    Segment reader;
+    if (!reader.open(spool->segmentPath(spool->r_segment), 0, false)) {
+      if (spool->r_segment >= w_segment) {
+        spool->setError("Missing spool segment " + spool->segmentPath(spool->r_segment));
+        break;
+      }
+      spool->r_segment++;
+      spool->r_offset = 0;
+      continue;
+    }
+
+    size_t limit = spool->r_segment == w_segment ? w_offset : reader.end();
+    std::vector<uint32_t> lengths;
+    size_t offset = spool->r_offset;
+    uint32_t len;
+
+    mongoc_bulk_operation_t *bulk = mongoc_collection_create_bulk_operation(collection, true, nullptr);
+    while (offset < limit && (int64_t) lengths.size() < options.batch_docs &&
+           (len = reader.documentAt(offset))) {
+      bson_t doc;
+      bson_init_static(&doc, reader.map + offset, len);
+      mongoc_bulk_operation_insert(bulk, &doc);
+      lengths.push_back(len);
+      offset += len;
+    }
+
+    // A fully replayed segment other than the one being written is removed
+    if (lengths.empty()) {
+      mongoc_bulk_operation_destroy(bulk);
+      reader.close();
+      if (spool->r_segment >= w_segment) {
+        break;
+      }
+      unlink(spool->segmentPath(spool->r_segment).c_str());
+      spool->r_segment++;
+      spool->r_offset = 0;
+      write_checkpoint(spool);
+      continue;
+    }
+
+    bson_t reply;
+    bson_error_t error;
+    bool ok = mongoc_bulk_operation_execute(bulk, &reply, &error);
+
+    // The bulk is ordered, so what was applied is a prefix of the batch. A
+    // duplicate _id means the document was inserted by an earlier replay
+    // that did not get to checkpoint.
+    size_t applied = ok ? lengths.size() : inserted_count(&reply);
+    bool duplicate = !ok && error.code == 11000;
+    if (duplicate && applied < lengths.size()) {
+      applied++;
+    }
+    bson_destroy(&reply);
+    mongoc_bulk_operation_destroy(bulk);
+    reader.close();
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < applied; i++) {
+      bytes += lengths[i];
+    }
+    spool->r_offset += bytes;
+    spool->replayed += applied;
+    spool->pending_bytes -= bytes;
+    total += applied;
+    write_checkpoint(spool);
+
+    if (!ok && !duplicate) {
+      spool->setError(error.message);
+      break;
+    }
+  }
+
+  mongoc_collection_destroy(collection);
+  mongoc_client_pool_push(pool, client);
+  return total;
+}
+
+void replay_thread() {
+  std::unique_lock<std::mutex> lock(s_thread_lock);
+
+  while (!s_stopping) {
+    s_wakeup.wait_for(lock, std::chrono::milliseconds(mongo_spool_options().replay_interval_ms));
+    if (s_stopping) {
+      break;
+    }
+
+    lock.unlock();
+    mongo_spool_replay();
+    lock.lock();
+  }
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void mongo_spool_configure(const MongoSpoolOptions& options) {
+  std::lock_guard<std::mutex> guard(s_options_lock);
+  s_options = options;
+}
+
+MongoSpoolOptions mongo_spool_options() {
+  std::lock_guard<std::mutex> guard(s_options_lock);
+  return s_options;
+}
+
+void mongo_spool_enable(const std::string& uri, const std::string& ns) {
+  MongoSpoolOptions options = mongo_spool_options();
+  {
+    std::lock_guard<std::mutex> guard(s_spools_lock);
+    auto& spool = s_spools[spool_key(uri, ns)];
+    if (spool) {
+      return;
+    }
+
+    char hash[20];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long) std::hash<std::string>()(uri));
+    spool.reset(new Spool);
+    spool->uri = uri;
+    spool->ns = ns;
+    spool->dir = options.dir + "/" + hash + "-" + ns;
+    mkdir(options.dir.c_str(), 0755);
+    mkdir(spool->dir.c_str(), 0755);
+    recover(spool.get(), options.segment_bytes);
+  }
+
+  std::lock_guard<std::mutex> guard(s_thread_lock);
+  if (!s_thread_started && !s_stopping) {
+    s_thread = std::thread(replay_thread);
+    s_thread_started = true;
+  }
+}
+
+bool mongo_spool_enabled(const std::string& uri, const std::string& ns) {
+  return find_spool(uri, ns) != nullptr;
+}
+
+bool mongo_spool_pending(const std::string& uri, const std::string& ns) {
+  Spool *spool = find_spool(uri, ns);
+  return spool && spool->has_pending;
+}
+
+bool mongo_spool_append(const std::string& uri, const std::string& ns,
+                        const bson_t *doc, std::string *error) {
+  Spool *spool = find_spool(uri, ns);
+  if (!spool) {
+    *error = "Namespace " + ns + " is not spooled";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(spool->write_lock);
+  if (!spool->writer.map) {
+    *error = "Spool segment for " + ns + " is not open";
+    return false;
+  }
+  if (doc->len >= spool->writer.size) {
+    *error = "Document is larger than a spool segment";
+    return false;
+  }
+
+  // Rotate, leaving at least the zero length that marks the end
+  if (spool->w_offset + doc->len >= spool->writer.size) {
+    size_t size = spool->writer.size;
+    msync(spool->writer.map, size, MS_SYNC);
+    spool->writer.close();
+    spool->w_segment++;
+    spool->w_offset = 0;
+    if (!spool->writer.open(spool->segmentPath(spool->w_segment), size, true)) {
+      *error = std::string("Unable to open spool segment: ") + strerror(errno);
+      return false;
+    }
+  }
+
+  memcpy(spool->writer.map + spool->w_offset, bson_get_data(doc), doc->len);
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = spool->w_offset / page * page;
+  msync(spool->writer.map + start, spool->w_offset + doc->len - start, MS_ASYNC);
+  spool->w_offset += doc->len;
+
+  spool->spooled++;
+  spool->pending_bytes += doc->len;
+  spool->has_pending = true;
+  return true;
+}
+
+int64_t mongo_spool_replay() {
+  std::vector<Spool *> spools;
+  {
+    std::lock_guard<std::mutex> guard(s_spools_lock);
+    for (auto& entry : s_spools) {
+      spools.push_back(entry.second.get());
+    }
+  }
+
+  int64_t total = 0;
+  for (Spool *spool : spools) {
+    if (spool->has_pending) {
+      total += replay(spool);
+    }
+  }
+  return total;
+}
+
+std::vector<MongoSpoolStats> mongo_spool_stats() {
+  std::lock_guard<std::mutex> guard(s_spools_lock);
+  std::vector<MongoSpoolStats> ret;
+
+  for (auto& entry : s_spools) {
+    Spool *spool = entry.second.get();
+    MongoSpoolStats stats;
+    stats.uri = spool->uri;
+    stats.ns = spool->ns;
+    stats.spooled = spool->spooled;
+    stats.replayed = spool->replayed;
+    stats.pending_bytes = spool->pending_bytes;
+    {
+      std::lock_guard<std::mutex> write_guard(spool->write_lock);
+      stats.segments = spool->w_segment;
+    }
+    {
+      std::lock_guard<std::mutex> replay_guard(spool->replay_lock);
+      stats.segments = stats.segments - spool->r_segment + 1;
+    }
+    {
+      std::lock_guard<std::mutex> error_guard(spool->error_lock);
+      stats.last_error = spool->last_error;
+    }
+    ret.push_back(stats);
+  }
+  return ret;
+}
+
+// Spooled documents are already on disk; they are replayed by the next
+// process rather than delaying shutdown while the primary is unavailable
+void mongo_spool_shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(s_thread_lock);
+    s_stopping = true;
+  }
+  s_wakeup.notify_one();
+  if (s_thread.joinable()) {
+    s_thread.join();
+  }
+
+  std::lock_guard<std::mutex> guard(s_spools_lock);
+  for (auto& entry : s_spools) {
+    std::lock_guard<std::mutex> write_guard(entry.second->write_lock);
+    if (entry.second->writer.map) {
+      msync(entry.second->writer.map, entry.second->writer.size, MS_SYNC);
+    }
+    entry.second->writer.close();
+  }
+}
+
+} // namespace HPHP
@@ -0,0 +1,57 @@
+#ifndef incl_HPHP_EXT_MONGO_SPOOL_H_
+#define incl_HPHP_EXT_MONGO_SPOOL_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mongoc.h"
+
+namespace HPHP {
+
+// Durable spool for inserts into designated namespaces that could not be
+// sent, e.g. during a replica set election. Documents are appended as raw
+// BSON to memory-mapped segment files and replayed in order by a
+// background thread, which checkpoints its position after every batch.
+struct MongoSpoolOptions {
+  std::string dir = "/tmp/mongo-spool";
+  int64_t segment_bytes = 64 * 1024 * 1024;
+  int64_t replay_interval_ms = 1000;
+  int64_t batch_docs = 1000;
+};
+
+struct MongoSpoolStats {
+  std::string uri;
+  std::string ns;
+  int64_t spooled;
+  int64_t replayed;
+  int64_t pending_bytes;
+  int64_t segments;
+  std::string last_error;
+};
+
+void mongo_spool_configure(const MongoSpoolOptions& options);
+MongoSpoolOptions mongo_spool_options();
+
+// Designates a namespace; spooled documents left by a previous process
+// are picked up from the spool directory
+void mongo_spool_enable(const std::string& uri, const std::string& ns);
+bool mongo_spool_enabled(const std::string& uri, const std::string& ns);
+
+// True while documents of the namespace are waiting to be replayed; new
+// inserts then go to the spool too, so the server sees them in order
+bool mongo_spool_pending(const std::string& uri, const std::string& ns);
+
+bool mongo_spool_append(const std::string& uri, const std::string& ns,
+                        const bson_t *doc, std::string *error);
+
+// Replays every spool from the calling thread; returns the number of
+// documents written
+int64_t mongo_spool_replay();
+
+std::vector<MongoSpoolStats> mongo_spool_stats();
+
+void mongo_spool_shutdown();
+
+} // namespace HPHP
+
+#endif // incl_HPHP_EXT_MONGO_SPOOL_H_
@@ -0,0 +1,293 @@
+#include <string.h>
+#include <sys/time.h>
+#include <atomic>
+#include <vector>
+#include "ext_mongo.h"
+#include "mongo_types.h"
+#include "contrib/classes.h"
+#include "hphp/runtime/base/preg.h"
+#include "hphp/runtime/ext/datetime/ext_datetime.h"
+#include "hphp/runtime/vm/native-data.h"
+
+namespace HPHP {
+
+const StaticString
+  s_sec("sec"),
+  s_usec("usec"),
+  s_bin("bin"),
+  s_type("type"),
+  s_regex("regex"),
+  s_flags("flags"),
+  s_value("value"),
+  s_inc("inc");
+
+// Loaded once; systemlib classes persist across requests
+static Class *load_class(Class **cache, const StaticString& name) {
+  if (*cache == nullptr) {
+    *cache = Unit::loadClass(name.get());
+  }
+  return *cache;
+}
+
+// A systemlib class whose declared properties are read and written in
+// their slots, without a lookup by name on every access. The properties
+// stay real, so comparison, casts, var_export() and serialization see
+// them as they would on any other object.
+class MongoTypeClass {
+public:
+  MongoTypeClass(const StaticString& name,
+                 std::initializer_list<const StaticString*> props)
+    : m_name(name), m_props(props), m_slots(m_props.size(), kInvalidSlot) {}
+
+  Object create() {
+    return ObjectData::newInstance(load_class(&m_cls, m_name));
+  }
+
+  const Variant& get(const Object& obj, int prop) {
+    return tvAsCVarRef(&obj->propVec()[slot(prop)]);
+  }
+
+  void set(const Object& obj, int prop, const Variant& value) {
+    tvAsVariant(&obj->propVec()[slot(prop)]) = value;
+  }
+
+private:
+  Slot slot(int prop) {
+    if (m_slots[prop] == kInvalidSlot) {
+      m_slots[prop] = load_class(&m_cls, m_name)->lookupDeclProp(m_props[prop]->get());
+      assert(m_slots[prop] != kInvalidSlot);
+    }
+    return m_slots[prop];
+  }
+
+  const StaticString& m_name;
+  std::vector<const StaticString*> m_props;
+  std::vector<Slot> m_slots;
+  Class *m_cls = nullptr;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoDate
+
+enum { kDateSec, kDateUsec };
+static MongoTypeClass s_MongoDate_type(s_MongoDate, { &s_sec, &s_usec });
+
+// Seconds are floored, so usec is never negative for dates before 1970
+static void mongo_date_split(int64_t msec, int64_t *sec, int64_t *usec) {
+  *sec = msec / 1000;
+  int64_t rest = msec % 1000;
+  if (rest < 0) {
+    (*sec)--;
+    rest += 1000;
+  }
+  *usec = rest * 1000;
+}
+
+static void mongo_date_set(const Object& date, int64_t msec) {
+  int64_t sec, usec;
+  mongo_date_split(msec, &sec, &usec);
+  s_MongoDate_type.set(date, kDateSec, sec);
+  s_MongoDate_type.set(date, kDateUsec, usec);
+}
+
+Object mongo_date_create(int64_t msec) {
+  Object obj = s_MongoDate_type.create();
+  mongo_date_set(obj, msec);
+  return obj;
+}
+
+int64_t mongo_date_msec(const Object& date) {
+  return s_MongoDate_type.get(date, kDateSec).toInt64() * 1000 +
+         s_MongoDate_type.get(date, kDateUsec).toInt64() / 1000;
+}
+
+static void HHVM_METHOD(MongoDate, __construct, const Variant& sec, const Variant& usec) {
+  int64_t s = sec.toInt64();
+  int64_t us = usec.toInt64();
+
+  if (s < 0) {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    s = now.tv_sec;
+    us = now.tv_usec;
+  }
+  // Precision beyond milliseconds is not stored, as in the database
+  mongo_date_set(this_, s * 1000 + us / 1000);
+}
+
+static Object HHVM_METHOD(MongoDate, toDateTime) {
+  int64_t sec, usec;
+  mongo_date_split(mongo_date_msec(this_), &sec, &usec);
+
+  // Built from the timestamp in UTC, without formatting and parsing a
+  // string
+  return DateTimeData::wrap(NEWOBJ(DateTime)(sec, true));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoBinData
+
+enum { kBinDataBin, kBinDataType };
+static MongoTypeClass s_MongoBinData_type(s_MongoBinData, { &s_bin, &s_type });
+
+Object mongo_bindata_create(const String& bin, int type) {
+  Object obj = s_MongoBinData_type.create();
+  s_MongoBinData_type.set(obj, kBinDataBin, bin);
+  s_MongoBinData_type.set(obj, kBinDataType, type);
+  return obj;
+}
+
+String mongo_bindata_get(const Object& bindata, int *type) {
+  *type = (int) s_MongoBinData_type.get(bindata, kBinDataType).toInt64();
+  return s_MongoBinData_type.get(bindata, kBinDataBin).toString();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoRegex
+
+enum { kRegexRegex, kRegexFlags };
+static MongoTypeClass s_MongoRegex_type(s_MongoRegex, { &s_regex, &s_flags });
+
+// The delimited PHP pattern built by the last match(), with the regex and
+// flags strings it was built from. Properties assigned since then are
+// different strings, so comparing pointers tells whether it is current.
+// It is not serialized; match() builds it again.
+struct MongoRegexData {
+  String regex;
+  String flags;
+  String pcre;
+
+  Variant sleep() const {
+    return init_null_variant;
+  }
+
+  void wakeup(const Variant& content, ObjectData* obj) {}
+};
+
+Object mongo_regex_create(const char *regex, const char *flags) {
+  Object obj = s_MongoRegex_type.create();
+  s_MongoRegex_type.set(obj, kRegexRegex, String(regex, CopyString));
+  s_MongoRegex_type.set(obj, kRegexFlags, String(flags, CopyString));
+  return obj;
+}
+
+void mongo_regex_get(const Object& regex, String *pattern, String *flags) {
+  *pattern = s_MongoRegex_type.get(regex, kRegexRegex).toString();
+  *flags = s_MongoRegex_type.get(regex, kRegexFlags).toString();
+}
+
+// Unescaped delimiters in the pattern are escaped; of the BSON flags, l
+// (locale) has no PCRE equivalent and u selects UTF-8 mode as in PHP
+static String mongo_regex_pcre(const String& regex, const String& flags) {
+  std::string pcre = "/";
+  bool escaped = false;
+
+  for (int i = 0; i < regex.size(); i++) {
+    char c = regex[i];
+    if (c == '/' && !escaped) {
+      pcre += '\\';
+    }
+    escaped = c == '\\' && !escaped;
+    pcre += c;
+  }
+  pcre += '/';
+  for (int i = 0; i < flags.size(); i++) {
+    if (strchr("imsxu", flags[i])) {
+      pcre += flags[i];
+    }
+  }
+  return String(pcre);
+}
+
+static bool HHVM_METHOD(MongoRegex, match, const String& subject) {
+  auto data = Native::data<MongoRegexData>(this_.get());
+  String regex, flags;
+
+  mongo_regex_get(this_, &regex, &flags);
+  if (data->pcre.isNull() || regex.get() != data->regex.get() ||
+      flags.get() != data->flags.get()) {
+    data->regex = regex;
+    data->flags = flags;
+    data->pcre = mongo_regex_pcre(regex, flags);
+  }
+  // The compiled pattern comes from the runtime's process-wide PCRE
+  // cache, keyed by the pattern string
+  Variant ret = preg_match(data->pcre, subject);
+  if (ret.isBoolean()) {
+    mongoThrow<MongoException>(("invalid regex " + data->pcre).c_str());
+  }
+  return ret.toInt64() > 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// classes MongoInt32 and MongoInt64
+
+// value is a string, as the constructors take it
+enum { kIntValue };
+static MongoTypeClass s_MongoInt32_type(s_MongoInt32, { &s_value });
+static MongoTypeClass s_MongoInt64_type(s_MongoInt64, { &s_value });
+
+Object mongo_int32_create(int32_t value) {
+  Object obj = s_MongoInt32_type.create();
+  s_MongoInt32_type.set(obj, kIntValue, String((int64_t) value));
+  return obj;
+}
+
+int32_t mongo_int32_value(const Object& obj) {
+  return s_MongoInt32_type.get(obj, kIntValue).toInt32();
+}
+
+Object mongo_int64_create(int64_t value) {
+  Object obj = s_MongoInt64_type.create();
+  s_MongoInt64_type.set(obj, kIntValue, String(value));
+  return obj;
+}
+
+int64_t mongo_int64_value(const Object& obj) {
+  return s_MongoInt64_type.get(obj, kIntValue).toInt64();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class MongoTimestamp
+
+enum { kTimestampSec, kTimestampInc };
+static MongoTypeClass s_MongoTimestamp_type(s_MongoTimestamp, { &s_sec, &s_inc });
+
+// Increments handed out to timestamps created without one
+static std::atomic<uint32_t> s_timestamp_inc {0};
+
+Object mongo_timestamp_create(uint32_t sec, uint32_t inc) {
+  Object obj = s_MongoTimestamp_type.create();
+  s_MongoTimestamp_type.set(obj, kTimestampSec, (int64_t) sec);
+  s_MongoTimestamp_type.set(obj, kTimestampInc, (int64_t) inc);
+  return obj;
+}
+
+void mongo_timestamp_get(const Object& obj, uint32_t *sec, uint32_t *inc) {
+  *sec = s_MongoTimestamp_type.get(obj, kTimestampSec).toInt64();
+  *inc = s_MongoTimestamp_type.get(obj, kTimestampInc).toInt64();
+}
+
+static void HHVM_METHOD(MongoTimestamp, __construct, const Variant& sec, const Variant& inc) {
+  int64_t s = sec.toInt64();
+  int64_t i = inc.toInt64();
+
+  s_MongoTimestamp_type.set(this_, kTimestampSec, s < 0 ? (int64_t) time(nullptr) : s);
+  s_MongoTimestamp_type.set(this_, kTimestampInc, i < 0 ? (int64_t) s_timestamp_inc++ : i);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void MongoExtension::_initMongoTypes() {
+  HHVM_ME(MongoDate, __construct);
+  HHVM_ME(MongoDate, toDateTime);
+
+  // With sleep() and wakeup(), as objects with native data need them to
+  // be serialized
+  Native::registerNativeDataInfo<MongoRegexData>(s_MongoRegex.get());
+  HHVM_ME(MongoRegex, match);
+
+  HHVM_ME(MongoTimestamp, __construct);
+}
+
+} // namespace HPHP
@@ -0,0 +1,34 @@
+#ifndef incl_HPHP_EXT_MONGO_TYPES_H_
+#define incl_HPHP_EXT_MONGO_TYPES_H_
+
+#include "hphp/runtime/base/base-includes.h"
+
+namespace HPHP {
+
+// BSON value classes implemented natively, so decoding and encoding them
+// runs no PHP code. Their values are declared properties, accessed by slot
+// rather than looked up by name.
+
+// MongoDate, from and to milliseconds since the epoch
+Object mongo_date_create(int64_t msec);
+int64_t mongo_date_msec(const Object& date);
+
+// MongoBinData
+Object mongo_bindata_create(const String& bin, int type);
+String mongo_bindata_get(const Object& bindata, int *type);
+
+// MongoRegex, with pattern and flags kept apart as in BSON
+Object mongo_regex_create(const char *regex, const char *flags);
+void mongo_regex_get(const Object& regex, String *pattern, String *flags);
+
+// MongoInt32, MongoInt64 and MongoTimestamp
+Object mongo_int32_create(int32_t value);
+int32_t mongo_int32_value(const Object& obj);
+Object mongo_int64_create(int64_t value);
+int64_t mongo_int64_value(const Object& obj);
+Object mongo_timestamp_create(uint32_t sec, uint32_t inc);
+void mongo_timestamp_get(const Object& obj, uint32_t *sec, uint32_t *inc);
+
+} // namespace HPHP
+
+#endif // incl_HPHP_EXT_MONGO_TYPES_H_
@@ -0,0 +1,205 @@
+#include "mongo_wire_stats.h"
+#include <string.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+
+#define MONGO_OP_COMPRESSED 2012
+
+// Outside the range of libmongoc's own stream types
+#define MONGO_WIRE_STATS_STREAM_TYPE 1000
+
+// Standard message header, then originalOpcode, uncompressedSize and
+// compressorId for OP_COMPRESSED
+#define MONGO_HEADER_SIZE 16
+#define MONGO_COMPRESSED_HEADER_SIZE 25
+
+namespace HPHP {
+
+namespace {
+
+struct Counters {
+  std::atomic<int64_t> bytes {0};
+  std::atomic<int64_t> bytes_uncompressed {0};
+  std::atomic<int64_t> messages {0};
+  std::atomic<int64_t> compressed {0};
+};
+
+Counters s_out;
+Counters s_in;
+
+std::atomic<int64_t> s_connections_tcp {0};
+std::atomic<int64_t> s_connections_unix {0};
+std::atomic<int64_t> s_connect_failures {0};
+
+// Follows message boundaries in one direction of a connection, whatever
+// the chunks the bytes arrive in
+class MessageScanner {
+public:
+  explicit MessageScanner(Counters *counters) : m_counters(counters) {}
+
+  void feed(const uint8_t *data, size_t len) {
+    while (len > 0) {
+      if (m_remaining > 0) {
+        size_t skip = std::min<size_t>(len, m_remaining);
+        m_remaining -= skip;
+        data += skip;
+        len -= skip;
+        continue;
+      }
+
+      size_t want = m_compressed ? MONGO_COMPRESSED_HEADER_SIZE : MONGO_HEADER_SIZE;
+      size_t take = std::min(len, want - m_have);
+      memcpy(m_header + m_have, data, take);
+      m_have += take;
+      data += take;
+      len -= take;
+
+      if (m_have == want) {
+        header_complete();
+      }
+    }
+  }
+
+private:
+  int32_t field(size_t offset) const {
+    int32_t value;
+    memcpy(&value, m_header + offset, sizeof value);
+    return BSON_UINT32_FROM_LE(value);
+  }
+
+  void header_complete() {
+    int32_t length = field(0);
+
+    if (!m_compressed && field(12) == MONGO_OP_COMPRESSED) {
+      m_compressed = true;
+      return;
+    }
+
+    m_counters->bytes += length;
+    m_counters->messages++;
+    if (m_compressed) {
+      m_counters->bytes_uncompressed += MONGO_HEADER_SIZE + field(20);
+      m_counters->compressed++;
+    } else {
+      m_counters->bytes_uncompressed += length;
+    }
+
+    m_remaining = std::max<int64_t>(0, length - (int64_t) m_have);
+    m_have = 0;
+    m_compressed = false;
+  }
+
+  Counters *m_counters;
+  uint8_t m_header[MONGO_COMPRESSED_HEADER_SIZE];
+  size_t m_have = 0;
+  int64_t m_remaining = 0;
+  bool m_compressed = false;
+};
+
+struct WireStatsStream {
+  mongoc_stream_t vtable;
+  mongoc_stream_t *base;
+  MessageScanner *out;
+  MessageScanner *in;
+};
+
+void feed_iov(MessageScanner *scanner, mongoc_iovec_t *iov, size_t iovcnt, ssize_t len) {
+  for (size_t i = 0; i < iovcnt && len > 0; i++) {
+    size_t chunk = std::min<size_t>(iov[i].iov_len, len);
+    scanner->feed((const uint8_t *) iov[i].iov_base, chunk);
+    len -= chunk;
+  }
+}
+
+void stream_destroy(mongoc_stream_t *stream) {
+  auto wrapper = (WireStatsStream *) stream;
+  mongoc_stream_destroy(wrapper->base);
+  delete wrapper->out;
+  delete wrapper->in;
+  delete wrapper;
+}
+
+int stream_close(mongoc_stream_t *stream) {
+  return mongoc_stream_close(((WireStatsStream *) stream)->base);
+}
+
+int stream_flush(mongoc_stream_t *stream) {
+  return mongoc_stream_flush(((WireStatsStream *) stream)->base);
+}
+
+ssize_t stream_writev(mongoc_stream_t *stream, mongoc_iovec_t *iov, size_t iovcnt,
+                      int32_t timeout_msec) {
+  auto wrapper = (WireStatsStream *) stream;
+  ssize_t ret = mongoc_stream_writev(wrapper->base, iov, iovcnt, timeout_msec);
+  feed_iov(wrapper->out, iov, iovcnt, ret);
+  return ret;
+}
+
+ssize_t stream_readv(mongoc_stream_t *stream, mongoc_iovec_t *iov, size_t iovcnt,
+                     size_t min_bytes, int32_t timeout_msec) {
+  auto wrapper = (WireStatsStream *) stream;
+  ssize_t ret = mongoc_stream_readv(wrapper->base, iov, iovcnt, min_bytes, timeout_msec);
+  feed_iov(wrapper->in, iov, iovcnt, ret);
+  return ret;
+}
+
+int stream_setsockopt(mongoc_stream_t *stream, int level, int optname,
+                      void *optval, socklen_t optlen) {
+  return mongoc_stream_setsockopt(((WireStatsStream *) stream)->base, level, optname, optval, optlen);
+}
+
+mongoc_stream_t *stream_get_base_stream(mongoc_stream_t *stream) {
+  return ((WireStatsStream *) stream)->base;
+}
+
+bool stream_check_closed(mongoc_stream_t *stream) {
+  return mongoc_stream_check_closed(((WireStatsStream *) stream)->base);
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+mongoc_stream_t *mongo_wire_stats_stream_new(mongoc_stream_t *base) {
+  if (!base) {
+    return nullptr;
+  }
+
+  auto wrapper = new WireStatsStream();
+  memset(&wrapper->vtable, 0, sizeof wrapper->vtable);
+  wrapper->vtable.type = MONGO_WIRE_STATS_STREAM_TYPE;
+  wrapper->vtable.destroy = stream_destroy;
+  wrapper->vtable.close = stream_close;
+  wrapper->vtable.flush = stream_flush;
+  wrapper->vtable.writev = stream_writev;
+  wrapper->vtable.readv = stream_readv;
+  wrapper->vtable.setsockopt = stream_setsockopt;
+  // No poll function: mongoc_stream_poll() descends to the base stream
+  wrapper->vtable.get_base_stream = stream_get_base_stream;
+  wrapper->vtable.check_closed = stream_check_closed;
+  wrapper->base = base;
+  wrapper->out = new MessageScanner(&s_out);
+  wrapper->in = new MessageScanner(&s_in);
+  return (mongoc_stream_t *) wrapper;
+}
+
+void mongo_wire_stats_connect(int family, bool ok) {
+  if (!ok) {
+    s_connect_failures++;
+  } else if (family == AF_UNIX) {
+    s_connections_unix++;
+  } else {
+    s_connections_tcp++;
+  }
+}
+
+MongoWireStats mongo_wire_stats() {
+  return MongoWireStats {
+    s_out.bytes, s_out.bytes_uncompressed, s_in.bytes, s_in.bytes_uncompressed,
+    s_out.messages, s_in.messages, s_out.compressed, s_in.compressed,
+    s_connections_tcp, s_connections_unix, s_connect_failures
+  };
+}
+
+} // namespace HPHP
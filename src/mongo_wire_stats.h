@@ -0,0 +1,36 @@
+#ifndef incl_HPHP_EXT_MONGO_WIRE_STATS_H_
+#define incl_HPHP_EXT_MONGO_WIRE_STATS_H_
+
+#include <stdint.h>
+#include "mongoc.h"
+
+namespace HPHP {
+
+// Process-wide byte counters of the wire protocol. A stream wrapper reads
+// the header of every message passing through it, so OP_COMPRESSED
+// messages are counted both as sent and at their uncompressed size.
+struct MongoWireStats {
+  int64_t bytes_out;
+  int64_t bytes_out_uncompressed;
+  int64_t bytes_in;
+  int64_t bytes_in_uncompressed;
+  int64_t messages_out;
+  int64_t messages_in;
+  int64_t compressed_out;
+  int64_t compressed_in;
+  int64_t connections_tcp;
+  int64_t connections_unix;
+  int64_t connect_failures;
+};
+
+// Takes ownership of base
+mongoc_stream_t *mongo_wire_stats_stream_new(mongoc_stream_t *base);
+
+// Counts a connection attempt of the given address family
+void mongo_wire_stats_connect(int family, bool ok);
+
+MongoWireStats mongo_wire_stats();
+
+} // namespace HPHP
+
+#endif // incl_HPHP_EXT_MONGO_WIRE_STATS_H_
@@ -0,0 +1,380 @@
+#include "mongo_write_queue.h"
+#include "mongo_common.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace HPHP {
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+// Bounded lock-free ring for many producers and one consumer. Each cell
+// carries a sequence number telling whether it is free for the producer
+// at that position or filled for the consumer.
+
+class WriteRing {
+public:
+  explicit WriteRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    m_mask = size - 1;
+    m_cells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; i++) {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    m_enqueue.store(0, std::memory_order_relaxed);
+    m_dequeue.store(0, std::memory_order_relaxed);
+  }
+
+  // Takes ownership of doc's contents; false if the ring is full
+  bool push(std::string& doc) {
+    size_t pos = m_enqueue.load(std::memory_order_relaxed);
+    Cell *cell;
+
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+      if (diff == 0) {
+        if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_enqueue.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->doc.swap(doc);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Only called from the queue's driver thread
+  bool pop(std::string& doc) {
+    size_t pos = m_dequeue.load(std::memory_order_relaxed);
+    Cell *cell = &m_cells[pos & m_mask];
+
+    if (cell->sequence.load(std::memory_order_acquire) != pos + 1) {
+      return false;
+    }
+    doc.swap(cell->doc);
+    cell->doc.clear();
+    cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+    // Publishes what the consumer did before popping, see drain_thread()
+    m_dequeue.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  int64_t depth() const {
+    return (int64_t) (m_enqueue.load(std::memory_order_relaxed) -
+                      m_dequeue.load(std::memory_order_acquire));
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    std::string doc;
+  };
+
+  std::unique_ptr<Cell[]> m_cells;
+  size_t m_mask;
+  alignas(64) std::atomic<size_t> m_enqueue;
+  alignas(64) std::atomic<size_t> m_dequeue;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct WriteQueue {
+  WriteQueue(const std::string& uri, const std::string& ns, size_t capacity)
+    : uri(uri), ns(ns), ring(capacity) {}
+
+  std::string uri;
+  std::string ns;
+  WriteRing ring;
+
+  std::atomic<int64_t> enqueued {0};
+  std::atomic<int64_t> written {0};
+  std::atomic<int64_t> dropped {0};
+  std::atomic<int64_t> spilled {0};
+  std::atomic<int64_t> failed {0};
+  std::atomic<int64_t> in_flight {0};
+
+  std::mutex wake_lock;
+  std::condition_variable wake;
+  std::atomic<bool> stopping {false};
+  std::thread thread;
+
+  std::mutex spill_lock;
+  FILE *spill = nullptr;
+};
+
+std::mutex s_options_lock;
+MongoWriteQueueOptions s_options;
+
+std::mutex s_queues_lock;
+std::map<std::string, std::unique_ptr<WriteQueue>> s_queues;
+bool s_shutdown = false;
+
+// Queues live until shutdown, so producers cache them per thread and only
+// take the registry lock for a namespace they have not written to yet
+thread_local std::unordered_map<std::string, WriteQueue *> t_queues;
+
+std::string queue_key(const std::string& uri, const std::string& ns) {
+  return uri + '\0' + ns;
+}
+
+// Overflow files hold concatenated BSON, so MongoCollection::restoreFrom()
+// can replay them
+bool spill(WriteQueue *queue, const char *data, size_t len) {
+  std::lock_guard<std::mutex> guard(queue->spill_lock);
+
+  if (!queue->spill) {
+    std::string path = mongo_write_queue_options().spill_dir + "/mongo-spill-" +
+                       queue->ns + "-" + std::to_string(getpid()) + ".bson";
+    queue->spill = fopen(path.c_str(), "ab");
+    if (!queue->spill) {
+      return false;
+    }
+  }
+  if (fwrite(data, 1, len, queue->spill) != len || fflush(queue->spill) != 0) {
+    return false;
+  }
+  queue->spilled++;
+  return true;
+}
+
+bool write_batch(WriteQueue *queue, const std::vector<std::string>& batch, int32_t w) {
+  mongoc_client_pool_t *pool = get_client_pool(queue->uri);
+  if (!pool) {
+    return false;
+  }
+
+  mongoc_client_t *client = mongoc_client_pool_pop(pool);
+  size_t dot = queue->ns.find('.');
+  mongoc_collection_t *collection = mongoc_client_get_collection(
+    client, queue->ns.substr(0, dot).c_str(), queue->ns.substr(dot + 1).c_str());
+  mongoc_write_concern_t *write_concern = mongoc_write_concern_new();
+  mongoc_write_concern_set_w(write_concern, w);
+  mongoc_bulk_operation_t *bulk = mongoc_collection_create_bulk_operation(collection, false, write_concern);
+
+  for (auto& doc : batch) {
+    bson_t b;
+    bson_init_static(&b, (const uint8_t *) doc.data(), doc.size());
+    mongoc_bulk_operation_insert(bulk, &b);
+  }
+
+  bson_t reply;
+  bson_error_t error;
+  bool ok = mongoc_bulk_operation_execute(bulk, &reply, &error);
+
+  bson_destroy(&reply);
+  mongoc_bulk_operation_destroy(bulk);
+  mongoc_write_concern_destroy(write_concern);
+  mongoc_collection_destroy(collection);
+  mongoc_client_pool_push(pool, client);
+  return ok;
+}
+
+void drain_thread(WriteQueue *queue) {
+  std::vector<std::string> batch;
+  std::string doc;
+
+  for (;;) {
+    MongoWriteQueueOptions options = mongo_write_queue_options();
+
+    // Counted in flight before the pop moves the dequeue index, so drain(),
+    // which reads the depth first, never sees a document that is neither
+    // queued nor in flight
+    while ((int64_t) batch.size() < options.batch_docs) {
+      queue->in_flight++;
+      if (!queue->ring.pop(doc)) {
+        queue->in_flight--;
+        break;
+      }
+      batch.push_back(std::move(doc));
+    }
+
+    if (batch.empty()) {
+      if (queue->stopping) {
+        return;
+      }
+      // Producers only notify when the ring was empty, without taking the
+      // lock; the timeout bounds the latency of a missed wakeup
+      std::unique_lock<std::mutex> lock(queue->wake_lock);
+      queue->wake.wait_for(lock, std::chrono::milliseconds(10));
+      continue;
+    }
+
+    if (write_batch(queue, batch, options.w)) {
+      queue->written += batch.size();
+    } else if (options.policy == MongoWriteQueuePolicy::Spill) {
+      for (auto& failed_doc : batch) {
+        if (!spill(queue, failed_doc.data(), failed_doc.size())) {
+          queue->failed++;
+        }
+      }
+    } else {
+      queue->failed += batch.size();
+    }
+
+    queue->in_flight -= batch.size();
+    batch.clear();
+  }
+}
+
+WriteQueue *get_queue(const std::string& uri, const std::string& ns) {
+  std::string key = queue_key(uri, ns);
+
+  auto cached = t_queues.find(key);
+  if (cached != t_queues.end()) {
+    return cached->second;
+  }
+
+  std::lock_guard<std::mutex> guard(s_queues_lock);
+  if (s_shutdown) {
+    return nullptr;
+  }
+
+  auto& queue = s_queues[key];
+  if (!queue) {
+    queue.reset(new WriteQueue(uri, ns, mongo_write_queue_options().capacity));
+    queue->thread = std::thread(drain_thread, queue.get());
+  }
+  t_queues[key] = queue.get();
+  return queue.get();
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+void mongo_write_queue_configure(const MongoWriteQueueOptions& options) {
+  std::lock_guard<std::mutex> guard(s_options_lock);
+  s_options = options;
+}
+
+MongoWriteQueueOptions mongo_write_queue_options() {
+  std::lock_guard<std::mutex> guard(s_options_lock);
+  return s_options;
+}
+
+bool mongo_write_queue_push(const std::string& uri, const std::string& ns,
+                            const bson_t *doc) {
+  WriteQueue *queue = get_queue(uri, ns);
+  if (!queue) {
+    return false;
+  }
+
+  std::string data((const char *) bson_get_data(doc), doc->len);
+  bool was_empty = queue->ring.depth() == 0;
+
+  if (queue->ring.push(data)) {
+    queue->enqueued++;
+    if (was_empty) {
+      queue->wake.notify_one();
+    }
+    return true;
+  }
+
+  MongoWriteQueueOptions options = mongo_write_queue_options();
+  switch (options.policy) {
+  case MongoWriteQueuePolicy::Block:
+  {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(options.block_timeout_ms);
+    queue->wake.notify_one();
+    while (std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      if (queue->ring.push(data)) {
+        queue->enqueued++;
+        return true;
+      }
+    }
+    break;
+  }
+  case MongoWriteQueuePolicy::Spill:
+    if (spill(queue, data.data(), data.size())) {
+      return true;
+    }
+    break;
+  default:
+    break;
+  }
+
+  queue->dropped++;
+  return false;
+}
+
+std::vector<MongoWriteQueueStats> mongo_write_queue_stats() {
+  std::lock_guard<std::mutex> guard(s_queues_lock);
+  std::vector<MongoWriteQueueStats> ret;
+
+  for (auto& entry : s_queues) {
+    WriteQueue *queue = entry.second.get();
+    ret.push_back(MongoWriteQueueStats {
+      queue->uri, queue->ns, queue->ring.depth(), queue->enqueued,
+      queue->written, queue->dropped, queue->spilled, queue->failed
+    });
+  }
+  return ret;
+}
+
+bool mongo_write_queue_drain(int64_t timeout_ms) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+  for (;;) {
+    bool idle = true;
+    {
+      std::lock_guard<std::mutex> guard(s_queues_lock);
+      for (auto& entry : s_queues) {
+        if (entry.second->ring.depth() > 0 || entry.second->in_flight > 0) {
+          idle = false;
+          entry.second->wake.notify_one();
+        }
+      }
+    }
+    if (idle) {
+      return true;
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void mongo_write_queue_shutdown() {
+  std::lock_guard<std::mutex> guard(s_queues_lock);
+  s_shutdown = true;
+
+  // Each driver thread exits once its ring is empty
+  for (auto& entry : s_queues) {
+    entry.second->stopping = true;
+    entry.second->wake.notify_one();
+  }
+  for (auto& entry : s_queues) {
+    WriteQueue *queue = entry.second.get();
+    if (queue->thread.joinable()) {
+      queue->thread.join();
+    }
+    if (queue->spill) {
+      fclose(queue->spill);
+      queue->spill = nullptr;
+    }
+  }
+}
+
+} // namespace HPHP
@@ -0,0 +1,53 @@
+#ifndef incl_HPHP_EXT_MONGO_WRITE_QUEUE_H_
+#define incl_HPHP_EXT_MONGO_WRITE_QUEUE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mongoc.h"
+
+namespace HPHP {
+
+// Process-wide queues of unacknowledged inserts, one bounded ring per
+// (connection string, namespace), each drained into bulk inserts by its
+// own driver thread.
+enum class MongoWriteQueuePolicy { Drop, Block, Spill };
+
+struct MongoWriteQueueOptions {
+  int64_t capacity = 16384;          // ring size, rounded up to a power of two
+  MongoWriteQueuePolicy policy = MongoWriteQueuePolicy::Drop;
+  int64_t block_timeout_ms = 100;    // Block: how long a producer waits for room before dropping
+  std::string spill_dir = "/tmp";    // Spill: directory of the overflow files
+  int64_t batch_docs = 1000;
+  int32_t w = MONGOC_WRITE_CONCERN_W_DEFAULT;
+};
+
+struct MongoWriteQueueStats {
+  std::string uri;
+  std::string ns;
+  int64_t depth;
+  int64_t enqueued;
+  int64_t written;
+  int64_t dropped;
+  int64_t spilled;
+  int64_t failed;
+};
+
+void mongo_write_queue_configure(const MongoWriteQueueOptions& options);
+MongoWriteQueueOptions mongo_write_queue_options();
+
+// Takes a complete BSON document; returns false if it was dropped
+bool mongo_write_queue_push(const std::string& uri, const std::string& ns,
+                            const bson_t *doc);
+
+std::vector<MongoWriteQueueStats> mongo_write_queue_stats();
+
+// Waits until every queue is empty; returns false on timeout
+bool mongo_write_queue_drain(int64_t timeout_ms);
+
+// Stops the driver threads after writing what is queued
+void mongo_write_queue_shutdown();
+
+} // namespace HPHP
+
+#endif // incl_HPHP_EXT_MONGO_WRITE_QUEUE_H_
@@ -25,15 +25,16 @@ class MongoDate
 	*
 	* @return - Returns this new date.
 	*/
-	public function __construct($sec = -1, $usec = 0) {
-		if ($sec < 0) {
-				$this->sec = time();
-		} else {
-				$this->sec = $sec;
-		}
+	<<__Native>>
+	public function __construct(mixed $sec = -1, mixed $usec = 0): void;
 
-		$this->usec = $usec;
-	}
+	/**
+	* Returns a DateTime representation of this date
+	*
+	* @return DateTime - This date in UTC, to the second.
+	*/
+	<<__Native>>
+	public function toDateTime(): DateTime;
 
 	/**
 	* Returns a string representation of this date
@@ -43,4 +44,4 @@ class MongoDate
 	public function __toString() {
 		return (string) $this->sec . ' ' . $this->usec;
 	}
-}
\ No newline at end of file
+}
@@ -29,4 +29,4 @@ class MongoInt32
 	{
 		return $this->value;
 	}
-}
\ No newline at end of file
+}
@@ -6,7 +6,7 @@
 */
 class MongoInt64
 {
-    public $value;
+	public $value;
 
 	/**
 	* Creates a new 64-bit integer.
@@ -15,18 +15,18 @@ class MongoInt64
 	*
 	* @return - Returns a new integer.
 	*/
-    public function __construct(string $value)
-    {
-        $this->value = $value;
-    }
+	public function __construct(string $value)
+	{
+		$this->value = $value;
+	}
 
 	/**
 	* Returns the string representation of this 64-bit integer.
 	*
 	* @return string - Returns the string representation of this integer.
 	*/
-    public function __toString()
-    {
-        return $this->value;
-    }
-}
\ No newline at end of file
+	public function __toString()
+	{
+		return $this->value;
+	}
+}
@@ -5,6 +5,7 @@
 * expressions will be used to query the database and find matching strings.
 * More unusually, they can be saved to the database and retrieved.
 */
+<<__NativeData("MongoRegex")>>
 class MongoRegex
 {
 	/**
@@ -42,6 +43,19 @@ class MongoRegex
           ((strlen($regex) && @preg_match($regex, null) !== false) || strlen($this->flags));
     }
 
+	/**
+	* Tests a string against this regular expression
+	*
+	* The pattern is compiled once per process and shared by every
+	* MongoRegex with the same pattern and flags.
+	*
+	* @param string $subject - The string to test.
+	*
+	* @return bool - Returns whether the string matches.
+	*/
+	<<__Native>>
+	public function match(string $subject): bool;
+
 	/**
 	* A string representation of this regular expression
 	*
@@ -6,27 +6,22 @@
 */
 class MongoTimestamp
 {
-    private static $globalInc = 0;
 	public $sec;
 	public $inc;
 
 	/**
 	* Creates a new timestamp.
 	*
+	* Without an increment, one is taken from a counter shared by the
+	* process.
+	*
 	* @param int $sec - Number of seconds since January 1st, 1970.
 	* @param int $inc - Increment.
 	*
 	* @return - Returns this new timestamp.
 	*/
-    public function __construct($sec = -1, $inc = -1) {
-        $this->sec = $sec < 0 ? time() : (int) $sec;
-        if ($inc < 0) {
-            $this->inc = self::$globalInc;
-            self::$globalInc++;
-        } else {
-            $this->inc = (int) $inc;
-        }
-    }
+	<<__Native>>
+	public function __construct(mixed $sec = -1, mixed $inc = -1): void;
 
 	/**
 	* Returns a string representation of this timestamp
@@ -37,4 +32,4 @@ class MongoTimestamp
     public function __toString() {
         return (string)$this->sec;
     }
-}
\ No newline at end of file
+}
@@ -1,5 +1,23 @@
 <?php
 
+class TypemapEntity {
+	public $name;
+	public $address;
+	private $secret;
+
+	public function getSecret() {
+		return $this->secret;
+	}
+}
+
+class TypemapAddress implements MongoBSONUnserializable {
+	public $fields;
+
+	public function bsonUnserialize(array $data) {
+		$this->fields = $data;
+	}
+}
+
 class DecodingTest extends PHPUnit_Framework_TestCase {
 
 	public function testDecoding() {
@@ -130,6 +148,207 @@ class DecodingTest extends PHPUnit_Framework_TestCase {
 		$this->assertEquals($out_doc, bson_decode(bson_encode($out_doc)));
 	}
 
+	public function testGetAndHas() {
+		$id = new MongoId();
+		$doc = array("_id" => $id,
+					 "version" => 3,
+					 "meta" => array("updated" => 1400000000, "tags" => array("a", "b")),
+					 "deleted" => null);
+		$bson = bson_encode($doc);
+
+		$this->assertEquals(3, bson_get($bson, "version"));
+		$this->assertEquals($id, bson_get($bson, "_id"));
+		$this->assertEquals(1400000000, bson_get($bson, "meta.updated"));
+		$this->assertEquals("b", bson_get($bson, "meta.tags.1"));
+		$this->assertEquals(array("a", "b"), bson_get($bson, "meta.tags"));
+		$this->assertEquals(null, bson_get($bson, "missing"));
+		$this->assertEquals(42, bson_get($bson, "meta.missing", 42));
+
+		$this->assertTrue(bson_has($bson, "meta.tags.0"));
+		$this->assertTrue(bson_has($bson, "deleted"));
+		$this->assertFalse(bson_has($bson, "meta.tags.2"));
+		$this->assertFalse(bson_has($bson, "version.x"));
+	}
+
+	public function testCompareAndSort() {
+		$a = bson_encode(array("name" => "a", "n" => 1, "tags" => array(5, 1)));
+		$b = bson_encode(array("name" => "b", "n" => 2.5, "tags" => array(3)));
+		$c = bson_encode(array("name" => "c", "n" => "text"));
+		$d = bson_encode(array("name" => "d", "n" => null));
+		$e = bson_encode(array("name" => "e"));
+
+		$this->assertEquals(-1, bson_compare($a, $b, array("n" => 1)));
+		$this->assertEquals(1, bson_compare($a, $b, array("n" => -1)));
+		$this->assertEquals(0, bson_compare($d, $e, array("n" => 1)));
+
+		// null/missing < numbers < strings
+		$sorted = bson_sort(array($c, $b, $e, $a, $d), array("n" => 1, "name" => 1));
+		$this->assertEquals(array($d, $e, $a, $b, $c), $sorted);
+
+		// arrays sort by their smallest element ascending, largest descending
+		$this->assertEquals(array($e, $a, $b), bson_sort(array($b, $a, $e), array("tags" => 1)));
+		$this->assertEquals(array($a, $b, $e), bson_sort(array($b, $a, $e), array("tags" => -1)));
+
+		// An empty array sorts below null; array() would encode as a document
+		$empty  = pack('C', 0x04);                       // byte: array type
+		$empty .= pack('a*x', 'tags');                   // cstring: field name
+		$empty .= pack('Vx', 5);                         // empty array
+		$empty .= pack('x');                             // null byte: document terminator
+		$empty  = pack('V', 4 + strlen($empty)) . $empty; // int32: document length
+		$this->assertEquals(array(), bson_decode($empty)["tags"]);
+		$this->assertEquals(-1, bson_compare($empty, $e, array("tags" => 1)));
+		$this->assertEquals(array($empty, $e, $a), bson_sort(array($a, $e, $empty), array("tags" => 1)));
+	}
+
+	public function testTypemap() {
+		$bson = bson_encode(array("name" => "Bob",
+								  "secret" => "x",
+								  "address" => array("city" => "NYC"),
+								  "tags" => array("a", "b")));
+
+		$doc = bson_decode($bson, array("typemap" => array("root" => "TypemapEntity",
+														   "fieldPaths" => array("address" => "TypemapAddress"))));
+		$this->assertInstanceOf("TypemapEntity", $doc);
+		$this->assertEquals("Bob", $doc->name);
+		$this->assertEquals("x", $doc->getSecret());
+		$this->assertInstanceOf("TypemapAddress", $doc->address);
+		$this->assertEquals(array("city" => "NYC"), $doc->address->fields);
+		$this->assertEquals(array("a", "b"), $doc->tags);
+
+		$doc = bson_decode($bson, array("typemap" => array("document" => "object")));
+		$this->assertTrue(is_array($doc));
+		$this->assertInstanceOf("stdClass", $doc["address"]);
+		$this->assertEquals("NYC", $doc["address"]->city);
+	}
+
+	public function testTypemapHackArrays() {
+		if (!function_exists('is_dict')) {
+			$this->markTestSkipped('dict and vec require HHVM 3.18');
+		}
+
+		$bson = bson_encode(array("name" => "Bob", "list" => array(1, 2), "nested" => array("0" => "x", "y" => "z")));
+		$doc = bson_decode($bson, array("typemap" => array("root" => "dict", "document" => "dict", "array" => "vec")));
+
+		$this->assertTrue(is_dict($doc));
+		$this->assertTrue(is_vec($doc["list"]));
+		$this->assertTrue(is_dict($doc["nested"]));
+		$this->assertTrue(array_key_exists("0", $doc["nested"]));
+		$this->assertEquals(2, $doc["list"][1]);
+	}
+
+	public function testTypemapUnknownClass() {
+		$this->setExpectedException('MongoException');
+		bson_decode(bson_encode(array("a" => 1)), array("typemap" => array("root" => "NoSuchClass")));
+	}
+
+	public function testTypemapKeysetRejected() {
+		// Documents may hold values a keyset cannot
+		$this->setExpectedException('MongoException');
+		bson_decode(bson_encode(array("a" => new MongoId())), array("typemap" => array("root" => "keyset")));
+	}
+
+	public function testLargeBinary() {
+		$blob = str_repeat("\x01\x02", 4096);
+		$bson = bson_encode(array("small" => new MongoBinData("ab"),
+		                          "large" => new MongoBinData($blob, MongoBinData::GENERIC)));
+
+		$decoded = bson_decode($bson);
+		$this->assertEquals("ab", $decoded["small"]->bin);
+		$this->assertEquals(new MongoBinData($blob, MongoBinData::GENERIC), $decoded["large"]);
+		$this->assertEquals($bson, bson_encode($decoded));
+
+		// Documents differing only in a blob do not compare equal
+		$other = bson_decode(bson_encode(array("small" => new MongoBinData("ab"),
+		                                       "large" => new MongoBinData($blob . "x", MongoBinData::GENERIC))));
+		$this->assertNotEquals($decoded, $other);
+
+		$decoded["large"]->bin .= "x";
+		$this->assertEquals($other, $decoded);
+	}
+
+	public function testBinDataEqualityAndSerialization() {
+		$bin = new MongoBinData("abc", MongoBinData::GENERIC);
+		$this->assertEquals(new MongoBinData("abc", MongoBinData::GENERIC), $bin);
+		$this->assertNotEquals(new MongoBinData("abd", MongoBinData::GENERIC), $bin);
+		$this->assertFalse($bin == new MongoBinData("abc", MongoBinData::BYTE_ARRAY));
+		$this->assertEquals(array("bin" => "abc", "type" => 0), (array) $bin);
+		$this->assertEquals($bin, unserialize(serialize($bin)));
+
+		$decoded = bson_decode(bson_encode(array("b" => $bin)));
+		$this->assertEquals($bin, $decoded["b"]);
+
+		$bin->bin .= "d";
+		$this->assertEquals("abcd", $bin->bin);
+	}
+
+	public function testRegex() {
+		$decoded = bson_decode(bson_encode(array("r" => new MongoRegex("/^a.c\\/d$/i"))));
+		$regex = $decoded["r"];
+		$this->assertInstanceOf("MongoRegex", $regex);
+		$this->assertEquals("^a.c\\/d$", $regex->regex);
+		$this->assertEquals("i", $regex->flags);
+		$this->assertTrue($regex->match("ABC/d"));
+		$this->assertFalse($regex->match("abd/d"));
+
+		// Unescaped delimiters in decoded patterns still match
+		$decoded["r"]->regex = "a/b";
+		$this->assertTrue($decoded["r"]->match("xa/by"));
+		$decoded["r"]->regex .= "c";
+		$this->assertFalse($decoded["r"]->match("xa/by"));
+	}
+
+	public function testRegexEqualityAndSerialization() {
+		$regex = new MongoRegex("/^abc/i");
+		$this->assertEquals(new MongoRegex("/^abc/i"), $regex);
+		$this->assertNotEquals(new MongoRegex("/^abc/m"), $regex);
+		$this->assertFalse($regex == new MongoRegex("/^abd/i"));
+		$this->assertEquals(array("regex" => "^abc", "flags" => "i"), (array) $regex);
+
+		$copy = unserialize(serialize($regex));
+		$this->assertEquals($regex, $copy);
+		$this->assertTrue($copy->match("ABCD"));
+
+		$decoded = bson_decode(bson_encode(array("r" => $regex)));
+		$this->assertEquals($regex, $decoded["r"]);
+	}
+
+	public function testIntegerObjects() {
+		$bson = bson_encode(array("a" => new MongoInt32("42"),
+		                          "b" => new MongoInt64("8589934592"),
+		                          "t" => new MongoTimestamp(1400000000, 7)));
+
+		$decoded = bson_decode($bson);
+		$this->assertSame(42, $decoded["a"]);
+		$this->assertEquals(1400000000, $decoded["t"]->sec);
+		$this->assertEquals(7, $decoded["t"]->inc);
+
+		$decoded = bson_decode($bson, array("integerObjects" => true));
+		$this->assertInstanceOf("MongoInt32", $decoded["a"]);
+		$this->assertSame("42", $decoded["a"]->value);
+		$this->assertSame("8589934592", (string) $decoded["b"]);
+		// Without the wrappers, 42 would come back as an int64
+		$this->assertEquals($bson, bson_encode($decoded));
+
+		$decoded["a"]->value = "7";
+		$this->assertEquals(array("a" => 7), bson_decode(bson_encode(array("a" => $decoded["a"]))));
+	}
+
+	public function testIntegerObjectsEqualityAndSerialization() {
+		$values = array("a" => new MongoInt32("42"),
+		                "b" => new MongoInt64("8589934592"),
+		                "t" => new MongoTimestamp(1400000000, 7));
+
+		$this->assertEquals(new MongoInt32("42"), $values["a"]);
+		$this->assertNotEquals(new MongoInt32("43"), $values["a"]);
+		$this->assertFalse($values["b"] == new MongoInt64("8589934593"));
+		$this->assertNotEquals(new MongoTimestamp(1400000000, 8), $values["t"]);
+		$this->assertEquals(array("sec" => 1400000000, "inc" => 7), (array) $values["t"]);
+		$this->assertEquals($values, unserialize(serialize($values)));
+
+		$decoded = bson_decode(bson_encode($values), array("integerObjects" => true));
+		$this->assertEquals($values, $decoded);
+	}
+
 	public function testDecodeCorruptException() {
 		$id1 = new MongoId();
 
@@ -0,0 +1,37 @@
+<?php
+
+// Compares findOne round trips to a co-located server over loopback TCP
+// and over its Unix domain socket:
+//
+//   hhvm -vDynamicExtensions.0=mongo.so test/findone-uds-bench.php \
+//     [iterations] [socket path]
+
+$iterations = isset($argv[1]) ? (int) $argv[1] : 10000;
+$socket = isset($argv[2]) ? $argv[2] : "/tmp/mongodb-27017.sock";
+
+$targets = array(
+  "tcp" => "mongodb://127.0.0.1:27017",
+  "unix" => "mongodb://" . urlencode($socket),
+);
+
+$seed = (new MongoClient($targets["tcp"]))->selectCollection("test", "uds_bench");
+$seed->drop();
+$seed->insert(array("_id" => 1, "name" => "bench"));
+
+foreach ($targets as $name => $uri) {
+  $coll = (new MongoClient($uri))->selectCollection("test", "uds_bench");
+  $coll->findOne(array("_id" => 1));
+
+  $start = microtime(true);
+  for ($i = 0; $i < $iterations; $i++) {
+    $coll->findOne(array("_id" => 1));
+  }
+  $elapsed = microtime(true) - $start;
+
+  printf("%-5s %8d findOne in %.3fs, %.1f us each\n",
+         $name, $iterations, $elapsed, $elapsed / $iterations * 1e6);
+}
+
+$stats = MongoClient::getWireStats();
+printf("connections: %d tcp, %d unix\n", $stats["connectionsTcp"], $stats["connectionsUnix"]);
+$seed->drop();
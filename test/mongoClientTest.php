@@ -7,4 +7,69 @@ class MongoClientTest extends MongoTestCase {
 		//var_dump((string) $cli);
 		//var_dump($cli->listDBs());
 	}
-} 	
\ No newline at end of file
+
+	public function testWrittenNamespaces() {
+		$cli = new MongoClient();
+		$this->assertEquals(array(), $cli->getWrittenNamespaces());
+
+		$coll = $cli->selectCollection(self::TEST_DB, "ryw_test");
+		$coll->insert(array("n" => 1));
+		$this->assertArrayHasKey(self::TEST_DB . ".ryw_test", $cli->getWrittenNamespaces());
+
+		// A secondary-eligible read after the write still sees it
+		$cursor = $coll->find(array("n" => 1));
+		$cursor->setReadPreference(MongoClient::RP_SECONDARY_PREFERRED);
+		$this->assertCount(1, iterator_to_array($cursor));
+
+		$coll->drop();
+	}
+
+	public function testResolverCache() {
+		MongoClient::configureResolver(array("ttl" => 60000));
+		$before = MongoClient::getResolverStats();
+
+		// A connection string not used before gets a new persistent client
+		$cli = new MongoClient("mongodb://localhost:27017/?connectTimeoutMS=" . mt_rand(1000, 9999));
+		$cli->getServerVersion();
+
+		$after = MongoClient::getResolverStats();
+		$this->assertGreaterThan(0, $after["entries"]);
+		$this->assertGreaterThan($before["hits"] + $before["misses"], $after["hits"] + $after["misses"]);
+	}
+
+	public function testWireCompression() {
+		$before = MongoClient::getWireStats();
+
+		$cli = new MongoClient("mongodb://localhost:27017/?connectTimeoutMS=" . mt_rand(1000, 9999),
+		                       array("compressors" => array("zlib"), "zlibCompressionLevel" => 6));
+		$coll = $cli->selectCollection(self::TEST_DB, "compression_test");
+		$coll->drop();
+		for ($i = 0; $i < 100; $i++) {
+			$coll->insert(array("padding" => str_repeat("x", 1000)));
+		}
+		$this->assertCount(100, iterator_to_array($coll->find()));
+
+		$after = MongoClient::getWireStats();
+		$this->assertGreaterThan($before["bytesInUncompressed"] + 100000, $after["bytesInUncompressed"]);
+		if ($after["compressedIn"] > $before["compressedIn"]) {
+			// Repetitive documents shrink on the wire
+			$this->assertLessThan($after["bytesInUncompressed"] - $before["bytesInUncompressed"],
+			                      $after["bytesIn"] - $before["bytesIn"]);
+		}
+		$coll->drop();
+	}
+
+	public function testUnixDomainSocket() {
+		$socket = "/tmp/mongodb-27017.sock";
+		if (!file_exists($socket)) {
+			$this->markTestSkipped("mongod does not listen on " . $socket);
+		}
+		$before = MongoClient::getWireStats();
+
+		$cli = new MongoClient("mongodb://" . urlencode($socket) . "/?connectTimeoutMS=" . mt_rand(1000, 9999));
+		$this->assertNotEmpty($cli->getServerVersion());
+
+		$after = MongoClient::getWireStats();
+		$this->assertGreaterThan($before["connectionsUnix"], $after["connectionsUnix"]);
+	}
+}
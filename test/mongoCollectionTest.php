@@ -12,6 +12,14 @@ class MongoCollectionStub extends MongoCollection {
 
 class MongoCollectionTest extends MongoTestCase {
 
+	protected function setUp() {
+		parent::setUp();
+		// The counter table is process-wide; start from the defaults
+		MongoCollection::configureCounters(array("flushInterval" => 1000,
+												 "maxPending" => 10000,
+												 "retry" => true));
+	}
+
 	public function testInsertAndRemove() {
 		$cli = $this->getTestClient();
 		$database_name = "test";
@@ -68,6 +76,81 @@ class MongoCollectionTest extends MongoTestCase {
 		// }
 	}
 
+	public function testIncrement() {
+		$coll = $this->getTestDB()->selectCollection("counters");
+		$coll->drop();
+		MongoCollection::configureCounters(array("flushInterval" => 60000));
+
+		for ($i = 0; $i < 10; $i++) {
+			$coll->increment("home", "views");
+		}
+		$coll->increment("home", "score", 1.5);
+		$coll->increment("about", "views", 3);
+
+		$this->assertEquals(2, MongoCollection::flushCounters());
+		$this->assertEquals(array("_id" => "home", "views" => 10, "score" => 1.5), $coll->findOne(array("_id" => "home")));
+		$this->assertEquals(array("_id" => "about", "views" => 3), $coll->findOne(array("_id" => "about")));
+		$this->assertEquals(0, MongoCollection::flushCounters());
+
+		// Without an interval, each increment is written by its caller
+		MongoCollection::configureCounters(array("flushInterval" => 0));
+		$coll->increment("home", "views", 5);
+		$this->assertEquals(15, $coll->findOne(array("_id" => "home"))["views"]);
+		$this->assertEquals(0, MongoCollection::flushCounters());
+
+		$coll->drop();
+	}
+
+	public function testIncrementWriteThroughFailure() {
+		$cli = new MongoClient("mongodb://127.0.0.1:1/?connectTimeoutMS=100&serverSelectionTimeoutMS=100");
+		$coll = $cli->selectCollection(self::TEST_DB, "counters_unreachable");
+		MongoCollection::configureCounters(array("flushInterval" => 0, "retry" => true));
+
+		try {
+			$coll->increment("home", "views");
+			$this->fail("Expected a MongoCursorException");
+		} catch (MongoCursorException $e) {
+		}
+		// The failed delta is reported, not left behind for a flush
+		$this->assertEquals(0, MongoCollection::flushCounters());
+	}
+
+	public function testDuplicateKeyException() {
+		$coll = $this->getTestDB()->selectCollection("duplicates");
+		$coll->drop();
+		$doc = array("_id" => "dup");
+		$coll->insert($doc);
+
+		try {
+			$doc = array("_id" => "dup");
+			$coll->insert($doc);
+			$this->fail("Expected a MongoDuplicateKeyException");
+		} catch (MongoDuplicateKeyException $e) {
+			$this->assertEquals(11000, $e->getCode());
+			// Still caught by handlers written for the old exception type
+			$this->assertInstanceOf("MongoCursorException", $e);
+		}
+		$coll->drop();
+	}
+
+	public function testDumpAndRestore() {
+		$db = $this->getTestDB();
+		$source = $db->selectCollection("students");
+		$target = $db->selectCollection("students_restored");
+		$target->drop();
+
+		$path = tempnam(sys_get_temp_dir(), "dump");
+		$dumped = $source->dumpTo($path);
+		$this->assertEquals($source->count(), $dumped);
+
+		$restored = $target->restoreFrom($path);
+		$this->assertEquals($dumped, $restored);
+		$this->assertEquals($dumped, $target->count());
+
+		unlink($path);
+		$target->drop();
+	}
+
 	public function testToIndexString() {
 		$db = $this->getTestDB();
 		$coll_name = "students";
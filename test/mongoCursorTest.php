@@ -58,6 +58,77 @@ class MongoCursorTest extends MongoTestCase {
 
 	}
 
+	public function testToColumns() {
+		$db = $this->getTestDB();
+		$coll = $db->selectCollection("students");
+		$count = $coll->count();
+
+		$columns = $coll->find()->toColumns(array("name", "no.such.field"), "none");
+		$this->assertEquals(array("name", "no.such.field"), array_keys($columns));
+		$this->assertEquals($count, count($columns["name"]));
+		$this->assertEquals(array_fill(0, $count, "none"), $columns["no.such.field"]);
+	}
+
+	public function testDrainAfterCurrent() {
+		$coll = $this->getTestDB()->selectCollection("drain_test");
+		$coll->drop();
+		for ($i = 0; $i < 4; $i++) {
+			$coll->insert(array("_id" => $i));
+		}
+
+		// Documents already handed out by current() are not drained again
+		$cursor = $coll->find()->sort(array("_id" => 1));
+		$cursor->rewind();
+		$this->assertEquals(0, $cursor->current()["_id"]);
+		$cursor->next();
+		$this->assertEquals(1, $cursor->current()["_id"]);
+		$this->assertEquals(array("_id" => array(2, 3)), $cursor->toColumns(array("_id")));
+
+		$cursor = $coll->find()->sort(array("_id" => 1));
+		$cursor->rewind();
+		$cursor->current();
+		$this->assertEquals(array(array("_id" => null, "n" => 3)),
+			$cursor->reduce(array("n" => array('$count' => 1))));
+
+		$coll->drop();
+	}
+
+	public function testReduce() {
+		$coll = $this->getTestDB()->selectCollection("reduce_test");
+		$coll->drop();
+		$coll->insert(array("country" => "us", "amount" => 10));
+		$coll->insert(array("country" => "us", "amount" => 2.5));
+		$coll->insert(array("country" => "fr", "amount" => 4));
+		$coll->insert(array("country" => "fr"));
+
+		$rows = $coll->find()->reduce(array("_id" => "country",
+											"total" => array('$sum' => "amount"),
+											"high" => array('$max' => "amount"),
+											"n" => array('$count' => 1)));
+		$this->assertEquals(array(
+			array("_id" => "us", "total" => 12.5, "high" => 10, "n" => 2),
+			array("_id" => "fr", "total" => 4, "high" => 4, "n" => 2),
+		), $rows);
+
+		$rows = $coll->find()->reduce(array("countries" => array('$distinct' => '$country'),
+											"avg" => array('$avg' => "amount")));
+		$this->assertEquals(array(array("_id" => null, "countries" => array("us", "fr"), "avg" => 16.5 / 3)), $rows);
+
+		// Numbers of different BSON types are the same key when equal
+		$coll->drop();
+		$coll->insert(array("k" => 1, "v" => 1.0));
+		$coll->insert(array("k" => new MongoInt32("1"), "v" => 1));
+		$coll->insert(array("k" => 1.0, "v" => new MongoInt32("1")));
+		$rows = $coll->find()->reduce(array("_id" => "k",
+											"values" => array('$distinct' => "v"),
+											"n" => array('$count' => 1)));
+		$this->assertCount(1, $rows);
+		$this->assertEquals(3, $rows[0]["n"]);
+		$this->assertCount(1, $rows[0]["values"]);
+
+		$coll->drop();
+	}
+
   public function testSetFlagOne() {
 		$cli = $this->getTestClient();
 		$database_name = "test.students";
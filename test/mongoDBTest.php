@@ -23,15 +23,63 @@ class MongoDBTest extends MongoTestCase {
 		//$res = $db->createCollection("hello");
 	}
 
+	public function testAuthenticateFailure() {
+		$db = $this->getTestDB();
+		$res = $db->authenticate("no-such-user", "p@ss:word");
+		$this->assertEquals(0, $res["ok"]);
+		$this->assertArrayHasKey("errmsg", $res);
+
+		// The client keeps its connection after a failed login
+		$db->selectCollection("auth")->findOne();
+	}
+
+	public function testAuthenticateChecksClientFromOptions() {
+		// Creates, without any round trip, the persistent client that
+		// authenticate() then looks up for the same credentials
+		new MongoClient("mongodb://localhost:27017",
+						array("username" => "no-such-user", "password" => "wrong", "db" => self::TEST_DB));
+
+		$res = $this->getTestDB()->authenticate("no-such-user", "wrong");
+		$this->assertEquals(0, $res["ok"]);
+	}
+
 	public function testGetCollectionNames() {
 		$cli = $this->getTestClient();
 		$new_colls = array("t1","t2","t3");
 		$db = $cli->selectDB("testCollectionNames");
-		foreach ($new_colls as $coll) {
-		//	$db->createCollection($coll);
+		$db->drop();
+		foreach (array_reverse($new_colls) as $coll) {
+			$db->createCollection($coll);
 		}
 
-		//$res = $db->getCollectionNames();
-		//$this->assertEquals($new_colls, $res);
+		$this->assertEquals($new_colls, $db->getCollectionNames());
+		$db->drop();
+	}
+
+	public function testMetadataCache() {
+		$db = $this->getTestClient()->selectDB("testMetadataCache");
+		$db->drop();
+		MongoDB::setMetadataCacheTTL(60000);
+
+		$coll = $db->createCollection("cached");
+		$this->assertEquals(array("cached"), $db->getCollectionNames());
+		$this->assertCount(1, $coll->getIndexInfo());
+
+		// Commands run directly are not seen until the cache is cleared
+		$db->command(array("create" => "uncached"));
+		$db->command(array("createIndexes" => "cached",
+		                   "indexes" => array(array("key" => array("a" => 1), "name" => "a_1"))));
+		$this->assertEquals(array("cached"), $db->getCollectionNames());
+		$this->assertCount(1, $coll->getIndexInfo());
+		MongoDB::clearMetadataCache($db);
+		$this->assertEquals(array("cached", "uncached"), $db->getCollectionNames());
+		$this->assertCount(2, $coll->getIndexInfo());
+
+		// Changes made through the driver invalidate it
+		$coll->deleteIndex(array("a" => 1));
+		$this->assertCount(1, $coll->getIndexInfo());
+
+		MongoDB::setMetadataCacheTTL(0);
+		$db->drop();
 	}
 }
\ No newline at end of file
@@ -6,4 +6,61 @@ class MongoDateTest extends MongoTestCase {
 		$date = new MongoDate();
 		//var_dump((string) $date);
 	}
-}
\ No newline at end of file
+
+	public function testPrecisionAndProperties() {
+		$date = new MongoDate(1400000000, 123456);
+		$this->assertEquals(1400000000, $date->sec);
+		$this->assertEquals(123000, $date->usec);
+		$this->assertEquals("1400000000 123000", (string) $date);
+
+		$date->sec = 1500000000;
+		$this->assertEquals(1500000000, $date->sec);
+		$this->assertEquals(123000, $date->usec);
+
+	}
+
+	public function testBefore1970() {
+		// A negative sec passed to the constructor means now
+		$date = new MongoDate();
+		$date->sec = -2;
+		$date->usec = 500000;
+
+		$decoded = bson_decode(bson_encode(array("d" => $date)));
+		$this->assertEquals(-2, $decoded["d"]->sec);
+		$this->assertEquals(500000, $decoded["d"]->usec);
+
+		$date->sec = 0;
+		$date->usec = -1000;
+		$decoded = bson_decode(bson_encode(array("d" => $date)));
+		$this->assertEquals(-1, $decoded["d"]->sec);
+		$this->assertEquals(999000, $decoded["d"]->usec);
+	}
+
+	public function testEqualityAndSerialization() {
+		$date = new MongoDate(1400000000, 123000);
+		$this->assertEquals(new MongoDate(1400000000, 123000), $date);
+		$this->assertNotEquals(new MongoDate(1400000000, 124000), $date);
+		$this->assertTrue($date == new MongoDate(1400000000, 123000));
+		$this->assertFalse($date == new MongoDate(1400000001, 123000));
+
+		$this->assertEquals(array("sec" => 1400000000, "usec" => 123000), (array) $date);
+		$this->assertEquals($date, unserialize(serialize($date)));
+		$this->assertContains("1400000000", var_export($date, true));
+
+		$decoded = bson_decode(bson_encode(array("d" => $date)));
+		$this->assertEquals($date, $decoded["d"]);
+	}
+
+	public function testRoundTrip() {
+		$decoded = bson_decode(bson_encode(array("d" => new MongoDate(1400000000, 987000))));
+		$this->assertInstanceOf("MongoDate", $decoded["d"]);
+		$this->assertEquals(1400000000, $decoded["d"]->sec);
+		$this->assertEquals(987000, $decoded["d"]->usec);
+	}
+
+	public function testToDateTime() {
+		$dt = (new MongoDate(1400000000, 5000))->toDateTime();
+		$this->assertInstanceOf("DateTime", $dt);
+		$this->assertEquals(1400000000, $dt->getTimestamp());
+	}
+}
@@ -0,0 +1,58 @@
+<?php
+
+class MongoMatcherTest extends PHPUnit_Framework_TestCase {
+
+	private function documents() {
+		return array(
+			"bob" => bson_encode(array("name" => "Bob", "age" => 20, "tags" => array("a", "b"), "address" => array("city" => "NYC"))),
+			"eva" => bson_encode(array("name" => "Eva", "age" => 35, "tags" => array("c"), "address" => array("city" => "SF"))),
+			"dan" => bson_encode(array("name" => "Dan", "age" => "unknown", "pets" => array(array("kind" => "cat"), array("kind" => "dog")))),
+		);
+	}
+
+	private function matching(array $filter) {
+		return array_keys(MongoMatcher::compile($filter)->filter($this->documents()));
+	}
+
+	public function testEquality() {
+		$this->assertEquals(array("eva"), $this->matching(array("name" => "Eva")));
+		$this->assertEquals(array("bob"), $this->matching(array("address.city" => "NYC")));
+		$this->assertEquals(array("bob"), $this->matching(array("tags" => "b")));
+		$this->assertEquals(array("dan"), $this->matching(array("pets.kind" => "dog")));
+		$this->assertEquals(array("dan"), $this->matching(array("address" => null)));
+	}
+
+	public function testRangeOperators() {
+		$this->assertEquals(array("eva"), $this->matching(array("age" => array('$gt' => 20))));
+		$this->assertEquals(array("bob", "eva"), $this->matching(array("age" => array('$gte' => 20, '$lte' => 35))));
+		// Range operators do not cross type brackets
+		$this->assertEquals(array(), $this->matching(array("age" => array('$gt' => 100))));
+		$this->assertEquals(array("dan"), $this->matching(array("age" => array('$gt' => ""))));
+	}
+
+	public function testSetAndExistsOperators() {
+		$this->assertEquals(array("bob", "dan"), $this->matching(array("name" => array('$in' => array("Bob", "Dan")))));
+		$this->assertEquals(array("eva"), $this->matching(array("tags" => array('$nin' => array("a")), "age" => array('$exists' => true, '$lt' => 100))));
+		$this->assertEquals(array("dan"), $this->matching(array("tags" => array('$exists' => false))));
+	}
+
+	public function testLogicalOperators() {
+		$filter = array('$or' => array(array("name" => "Bob"), array("age" => array('$gt' => 30))));
+		$this->assertEquals(array("bob", "eva"), $this->matching($filter));
+
+		$filter = array('$and' => array(array("tags" => "a"), array("tags" => "b")));
+		$this->assertEquals(array("bob"), $this->matching($filter));
+	}
+
+	public function testMatches() {
+		$matcher = MongoMatcher::compile(array("age" => array('$lt' => 30)));
+		$docs = $this->documents();
+		$this->assertTrue($matcher->matches($docs["bob"]));
+		$this->assertFalse($matcher->matches($docs["eva"]));
+	}
+
+	public function testUnsupportedOperator() {
+		$this->setExpectedException('MongoException', 'Unsupported query operator: $where');
+		MongoMatcher::compile(array('$where' => "this.a > 1"));
+	}
+}
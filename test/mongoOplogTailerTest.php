@@ -0,0 +1,42 @@
+<?php
+
+class MongoOplogTailerTest extends MongoTestCase {
+
+	protected function setUp() {
+		parent::setUp();
+		$oplog = $this->getTestClient()->selectCollection("local", "oplog.rs");
+		if (!$oplog->findOne()) {
+			$this->markTestSkipped("The oplog is only available on replica set members");
+		}
+	}
+
+	public function testPollAndResume() {
+		$coll = $this->getTestDB()->selectCollection("oplog_test");
+		$ns = self::TEST_DB . ".oplog_test";
+		$tailer = new MongoOplogTailer($this->getTestClient(), null, array("ns" => $ns));
+
+		$this->assertEquals(array(), $tailer->poll());
+		$start = $tailer->getPosition();
+		$this->assertInstanceOf("MongoTimestamp", $start);
+
+		$coll->insert(array("_id" => 1));
+		$coll->insert(array("_id" => 2));
+
+		$entries = $tailer->poll(1);
+		$this->assertCount(1, $entries);
+		$this->assertEquals("i", $entries[0]["op"]);
+		$this->assertEquals(array("_id" => 1), $entries[0]["o"]);
+		$this->assertEquals($entries[0]["ts"], $tailer->getPosition());
+
+		// A new tailer resumes after the checkpoint
+		$resumed = new MongoOplogTailer($this->getTestClient(), $tailer->getPosition(), array("ns" => $ns));
+		$entries = $resumed->poll();
+		$this->assertCount(1, $entries);
+		$this->assertEquals(array("_id" => 2), $entries[0]["o"]);
+
+		$tailer->seek($start);
+		$this->assertCount(2, $tailer->poll());
+
+		$coll->drop();
+	}
+}
@@ -0,0 +1,81 @@
+<?php
+
+class MongoQueueConsumerTest extends MongoTestCase {
+
+	public function testFetchAckAndResume() {
+		$db = $this->getTestDB();
+		$db->dropCollection("queue_test");
+		$db->dropCollection("queue_test.consumers");
+		$queue = $db->createCollection("queue_test", array("capped" => true, "size" => 100000));
+		for ($i = 0; $i < 5; $i++) {
+			$queue->insert(array("n" => $i));
+		}
+
+		$consumer = new MongoQueueConsumer($queue, "worker", array("prefetch" => 2, "flushInterval" => 60000));
+		$batch = $consumer->fetch(3);
+		$this->assertEquals(array(0, 1, 2), array_map(function($m) { return $m["n"]; }, $batch));
+
+		$consumer->ackAll($batch);
+		$stats = $consumer->getStats();
+		$this->assertEquals(3, $stats["received"]);
+		$this->assertEquals(3, $stats["pending_acks"]);
+		$this->assertEquals(0, $stats["flushes"]);
+
+		$this->assertTrue($consumer->flush());
+		$this->assertEquals(3, $db->selectCollection("queue_test.consumers")->findOne(array("_id" => "worker"))["acked"]);
+
+		// A new consumer with the same name resumes after the acknowledged position
+		$resumed = new MongoQueueConsumer($queue, "worker");
+		$batch = $resumed->fetch();
+		$this->assertEquals(array(3, 4), array_map(function($m) { return $m["n"]; }, $batch));
+
+		$db->dropCollection("queue_test");
+		$db->dropCollection("queue_test.consumers");
+	}
+
+	public function testConnectionErrorsReconnect() {
+		$db = $this->getTestDB();
+		$db->dropCollection("queue_unreachable.consumers");
+		$cli = new MongoClient("mongodb://127.0.0.1:1/?connectTimeoutMS=100&serverSelectionTimeoutMS=100");
+		$queue = $cli->selectCollection(self::TEST_DB, "queue_unreachable");
+
+		$consumer = new MongoQueueConsumer($queue, "worker",
+			array("progress" => $db->selectCollection("queue_unreachable.consumers")));
+		$this->assertEquals(array(), $consumer->fetch());
+		$this->assertEquals(array(), $consumer->fetch());
+		$this->assertEquals(2, $consumer->getStats()["reconnects"]);
+	}
+
+	public function testQueuesKeepProgressApart() {
+		$db = $this->getTestDB();
+		$queues = array();
+		foreach (array("queue_a", "queue_b") as $name) {
+			$db->dropCollection($name);
+			$db->dropCollection("$name.consumers");
+			$queues[$name] = $db->createCollection($name, array("capped" => true, "size" => 100000));
+			for ($i = 0; $i < 3; $i++) {
+				$queues[$name]->insert(array("n" => $i));
+			}
+		}
+
+		// Consumers of different queues may share a name
+		$a = new MongoQueueConsumer($queues["queue_a"], "worker");
+		$a->ackAll($a->fetch(2));
+		$this->assertTrue($a->flush());
+		$b = new MongoQueueConsumer($queues["queue_b"], "worker");
+		$b->ackAll($b->fetch(1));
+		$this->assertTrue($b->flush());
+
+		$this->assertEquals(2, $db->selectCollection("queue_a.consumers")->findOne(array("_id" => "worker"))["acked"]);
+		$this->assertEquals(1, $db->selectCollection("queue_b.consumers")->findOne(array("_id" => "worker"))["acked"]);
+		$this->assertNull($db->selectCollection("consumers")->findOne(array("_id" => "worker")));
+
+		$resumed = new MongoQueueConsumer($queues["queue_a"], "worker");
+		$this->assertEquals(array(2), array_map(function($m) { return $m["n"]; }, $resumed->fetch()));
+
+		foreach ($queues as $name => $queue) {
+			$db->dropCollection($name);
+			$db->dropCollection("$name.consumers");
+		}
+	}
+}
@@ -0,0 +1,54 @@
+<?php
+
+class MongoShardedClientTest extends MongoTestCase {
+
+	// Two connection strings for the same server act as two deployments
+	// that see the same data
+	private function client() {
+		return new MongoShardedClient(array("mongodb://localhost:27017", "mongodb://127.0.0.1:27017"), "tenant");
+	}
+
+	public function testRoutingIsStable() {
+		$client = $this->client();
+		$this->assertEquals($client->shardFor("acme"), $client->shardFor("acme"));
+		$this->assertNull($client->extractKey(array("tenant" => array('$in' => array("a", "b")))));
+		$this->assertEquals("acme", $client->extractKey(array("tenant" => "acme", "n" => 1)));
+
+		$shards = array();
+		for ($i = 0; $i < 100; $i++) {
+			$shards[$client->shardFor("tenant" . $i)] = true;
+		}
+		$this->assertCount(2, $shards);
+	}
+
+	public function testShardKeyNamingAFunction() {
+		// "count" is a field here, not the PHP function
+		$client = new MongoShardedClient(array("mongodb://localhost:27017", "mongodb://127.0.0.1:27017"), "count");
+		$this->assertEquals(7, $client->extractKey(array("count" => 7)));
+		$this->assertNull($client->extractKey(array("n" => 1)));
+
+		$client = new MongoShardedClient(array("mongodb://localhost:27017", "mongodb://127.0.0.1:27017"),
+										 function($doc) { return isset($doc["a"]) ? $doc["a"] . "/" . $doc["b"] : null; });
+		$this->assertEquals("x/y", $client->extractKey(array("a" => "x", "b" => "y")));
+	}
+
+	public function testScatterGatherMergesSortedResults() {
+		$client = $this->client();
+		$clients = $client->getClients();
+		$coll = $clients[0]->selectCollection(self::TEST_DB, "sharded_a");
+		$coll->drop();
+		$coll->batchInsert(array(array("n" => 3), array("n" => 1), array("n" => 2)));
+
+		$results = $client->scatterFind(self::TEST_DB, "sharded_a", array(), array("_id" => 0), array("n" => 1), 5);
+		$this->assertEquals(array(1, 1, 2, 2, 3), array_map(function($doc) { return $doc["n"]; }, $results));
+
+		$coll->drop();
+	}
+
+	/**
+	 * @expectedException MongoException
+	 */
+	public function testDuplicateUris() {
+		new MongoShardedClient(array("mongodb://localhost:27017", "mongodb://localhost:27017"), "tenant");
+	}
+}
@@ -0,0 +1,127 @@
+<?php
+
+class MongoSpoolTest extends MongoTestCase {
+
+	// Spools stay enabled for the whole process, so each test gets its own
+	// namespace and directory
+	private function configureSpool() {
+		$dir = sys_get_temp_dir() . "/mongo-spool-test-" . uniqid();
+		MongoSpool::configure(array("dir" => $dir,
+									"segmentSize" => 16 * 1024 * 1024,
+									"replayInterval" => 60000));
+		return $dir;
+	}
+
+	private function getSpoolStats($collection) {
+		foreach (MongoSpool::getStats() as $spool) {
+			if ($spool["ns"] == self::TEST_DB . "." . $collection) {
+				return $spool;
+			}
+		}
+		$this->fail("No spool for " . $collection);
+	}
+
+	public function testEnabledCollectionWritesThrough() {
+		MongoSpool::configure(array("dir" => sys_get_temp_dir() . "/mongo-spool-test"));
+		$coll = $this->getTestDB()->selectCollection("spool_test");
+		$coll->drop();
+		MongoSpool::enable($coll);
+
+		$this->assertTrue($coll->insert(array("n" => 1)));
+		$this->assertEquals(1, $coll->count());
+
+		$stats = array_values(array_filter(MongoSpool::getStats(), function($spool) {
+			return $spool["ns"] == self::TEST_DB . ".spool_test";
+		}));
+		$this->assertCount(1, $stats);
+		$this->assertEquals(0, $stats[0]["spooled"]);
+		$this->assertEquals(0, $stats[0]["pending_bytes"]);
+		$this->assertEquals(0, MongoSpool::replay());
+
+		$coll->drop();
+	}
+
+	public function testUnreachablePrimarySpoolsInserts() {
+		$this->configureSpool();
+		$cli = new MongoClient("mongodb://127.0.0.1:1/?connectTimeoutMS=100&serverSelectionTimeoutMS=100");
+		$coll = $cli->selectCollection(self::TEST_DB, "spool_unreachable");
+		MongoSpool::enable($coll);
+
+		$this->assertTrue($coll->insert(array("n" => 1)));
+		$stats = $this->getSpoolStats("spool_unreachable");
+		$this->assertEquals(1, $stats["spooled"]);
+		$this->assertGreaterThan(0, $stats["pending_bytes"]);
+
+		// Later inserts follow the pending ones into the spool, past the end
+		// of the first segment
+		$blob = str_repeat("x", 1024 * 1024);
+		for ($i = 0; $i < 17; $i++) {
+			$this->assertTrue($coll->insert(array("i" => $i, "blob" => $blob)));
+		}
+		$stats = $this->getSpoolStats("spool_unreachable");
+		$this->assertEquals(18, $stats["spooled"]);
+		$this->assertEquals(2, $stats["segments"]);
+
+		// Replay keeps everything until a primary is back
+		MongoSpool::replay();
+		$stats = $this->getSpoolStats("spool_unreachable");
+		$this->assertEquals(0, $stats["replayed"]);
+		$this->assertNotEquals("", $stats["last_error"]);
+	}
+
+	public function testServerErrorsAreNotSpooled() {
+		$this->configureSpool();
+		$coll = $this->getTestDB()->selectCollection("spool_duplicates");
+		$coll->drop();
+		MongoSpool::enable($coll);
+
+		$this->assertTrue($coll->insert(array("_id" => 1)));
+		try {
+			$coll->insert(array("_id" => 1));
+			$this->fail("Expected a MongoDuplicateKeyException");
+		} catch (MongoDuplicateKeyException $e) {
+		}
+		$this->assertEquals(0, $this->getSpoolStats("spool_duplicates")["spooled"]);
+
+		$coll->drop();
+	}
+
+	public function testRecoveryAndReplay() {
+		$dir = $this->configureSpool();
+		$db = $this->getTestDB();
+
+		// Spool directories are named after a hash of the connection string,
+		// so find it through another namespace of the same client
+		MongoSpool::enable($db->selectCollection("spool_probe"));
+		$probe = glob($dir . "/*-" . self::TEST_DB . ".spool_probe");
+		$this->assertCount(1, $probe);
+		$spool = substr($probe[0], 0, -strlen("spool_probe")) . "spool_recovered";
+
+		// Left by an earlier process that had replayed the first document
+		$first = bson_encode(array("_id" => 1));
+		mkdir($spool);
+		file_put_contents($spool . "/000000000001.seg",
+						  $first . bson_encode(array("_id" => 2)) . bson_encode(array("_id" => 3)));
+		file_put_contents($spool . "/checkpoint", "1 " . strlen($first) . "\n");
+
+		$coll = $db->selectCollection("spool_recovered");
+		$coll->drop();
+		MongoSpool::enable($coll);
+		MongoSpool::replay();
+
+		$this->assertEquals(2, $coll->count());
+		$this->assertNull($coll->findOne(array("_id" => 1)));
+		$stats = $this->getSpoolStats("spool_recovered");
+		$this->assertEquals(2, $stats["replayed"]);
+		$this->assertEquals(0, $stats["pending_bytes"]);
+
+		$coll->drop();
+	}
+
+	/**
+	 * @expectedException MongoException
+	 */
+	public function testSegmentSizeTooSmall() {
+		MongoSpool::configure(array("segmentSize" => 1024));
+	}
+}
@@ -0,0 +1,32 @@
+<?php
+
+class MongoWriteQueueTest extends MongoTestCase {
+
+	public function testInsertAsync() {
+		$coll = $this->getTestDB()->selectCollection("write_queue_test");
+		$coll->drop();
+
+		for ($i = 0; $i < 100; $i++) {
+			$this->assertTrue($coll->insertAsync(array("n" => $i)));
+		}
+		$this->assertTrue(MongoWriteQueue::drain(5000));
+		$this->assertEquals(100, $coll->count());
+
+		$stats = array_values(array_filter(MongoWriteQueue::getStats(), function($queue) {
+			return $queue["ns"] == self::TEST_DB . ".write_queue_test";
+		}));
+		$this->assertCount(1, $stats);
+		$this->assertEquals(0, $stats[0]["depth"]);
+		$this->assertEquals(100, $stats[0]["written"]);
+		$this->assertEquals(0, $stats[0]["dropped"]);
+
+		$coll->drop();
+	}
+
+	/**
+	 * @expectedException MongoException
+	 */
+	public function testUnknownPolicy() {
+		MongoWriteQueue::configure(array("policy" => "retry"));
+	}
+}